@@ -17,146 +17,831 @@
 #include <string.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <signal.h>
+#include <time.h>
 #include <coinc_config.h>
+#ifdef HAVE_FTRUNCATE
+#include <unistd.h>
+#endif
+#include "coinc_event.h"
+#include "coinc_input.h"
+#include "coinc_kernel.h"
+#include "coinc_engine.h"
+#include "coinc_lib.h"
+#include "coinc_pipeline.h"
+#include "coinc_output.h"
+#include "coinc_columnar.h"
+#include "coinc_parallel.h"
+#include "coinc_merge.h"
+#include "coinc_rules.h"
+#include "coinc_spectra.h"
+#include "coinc_monitor.h"
+#include "coinc_stats.h"
+#include "coinc_index.h"
+#include "coinc_checkpoint.h"
 
-#define N_ADCS_MAX 128
-#define COINC_TABLE_SIZE_DEFAULT 20
+#define COINC_TABLE_SIZE_DEFAULT ENGINE_TABLE_SIZE_DEFAULT
 #define N_ADCS_DEFAULT 8
 #define SKIP_LINES_DEFAULT 0
 #define TIMING_WINDOW_HIGH_DEFAULT 0
 #define TIMING_WINDOW_LOW_DEFAULT 0
-#define TRIGGER_ADC_DEFAULT 0
-#define MIN_MULTIPLICITY_DEFAULT 2
-#define HELP_TEXT "Usage: %s [OPTION] infile outfile\n\nIf no infile or outfile is specified, standard input or output is used respectively.\nValid options:\n\t--timestamps\toutput timestamps\n\t--both\t\toutput both data and timestamps (2 col/ch)\n\t--timediff\toutput both data and time difference to trigger time\n\t--nadc=NUM\tprocess a maximum of NUM ADCs\n\t--skip=NUM\tskip first NUM lines from the beginning of the input\n\t--tablesize=NUM\tuse a coincidence table of NUM events\n\t--nevents=NUM\toutput maximum of NUM events\n\t--trigger=NUM\tuse ADC NUM as the triggering ADC\n\t--verbose\tverbose output\n\t--low=ADC,NUM\tset timing window for ADC low (NUM ticks)\n\t--high=ADC,NUM\tset timing window for ADC high (NUM ticks)\n\t--multiplicity=NUM\tminimum of NUM channels per coincidence\n\t--require=ADC\tcoincidence must include ADC\n\t--triggertime\tinclude trigger event timestamp as first column\n\n"
+#define TRIGGER_ADC_DEFAULT ENGINE_TRIGGER_ADC_DEFAULT
+#define MIN_MULTIPLICITY_DEFAULT ENGINE_MIN_MULTIPLICITY_DEFAULT
+#define N_INPUTS_MAX 256
+#define FOLLOW_WAIT_MS 200 /* Longest wait for input with --follow before checking for a snapshot or a signal */
+#define HELP_TEXT "Usage: %s [OPTION] infile outfile\n\nIf no infile or outfile is specified, standard input or output is used respectively.\nValid options:\n\t--timestamps\toutput timestamps\n\t--both\t\toutput both data and timestamps (2 col/ch)\n\t--timediff\toutput both data and time difference to trigger time\n\t--nadc=NUM\tprocess a maximum of NUM ADCs\n\t--skip=NUM\tskip first NUM lines (events in binary input) from the beginning of the input\n\t--input-format=FMT\tinput is in format FMT, text (default) or bin\n\t--tablesize=NUM\tuse a coincidence table of at most NUM events (default 1048576)\n\t--nevents=NUM\toutput maximum of NUM events\n\t--trigger=NUM\tuse ADC NUM as the triggering ADC\n\t--verbose\tverbose output\n\t--low=ADC,NUM\tset timing window for ADC low (NUM ticks)\n\t--high=ADC,NUM\tset timing window for ADC high (NUM ticks)\n\t--multiplicity=NUM\tminimum of NUM channels per coincidence\n\t--require=ADC\tcoincidence must include ADC\n\t--triggertime\tinclude trigger event timestamp as first column\n\t--monitor=FILE\tinclude the count of events in FILE up to the trigger as a column (can be repeated)\n\t--kernel=NAME\tuse window search kernel NAME (avx512, avx2, sse4.2 or scalar, default: best supported)\n\t--output-format=FMT\toutput is in format FMT, text (default), columnar (binary, all columns, see coinc_columnar.h) or none\n\t--threads\tread, search and write in separate threads\n\t--follow\tkeep reading a growing input file or pipe until interrupted, writing coincidences out as they are found\n\t--latency=NUM\twith --follow, write a coincidence out at the latest when the input is NUM ticks past its windows (default 0)\n\t--snapshot-interval=NUM\twith --follow or --stats, print the summary and rewrite the --stats file every NUM seconds\n\t--parallel=NUM\tsearch chunks of the input file in NUM threads (input must be a time-ordered regular file)\n\t--parallel-chunk-size=NUM\twith --parallel, chunks are at least NUM bytes (default 16777216)\n\t--input=FILE\tmerge time-ordered input FILE with the other inputs given this way (infile is then not given)\n\t--adc-offset=NUM\tadd NUM to the ADCs of the previous --input\n\t--timestamp-offset=NUM\tadd NUM to the timestamps of the previous --input\n\t--timestamp-bits=NUM\ttimestamps are NUM-bit counters that roll over\n\t--triggerless=NUM\tno trigger, events within NUM ticks from the first one form an event\n\t--extending\twith --triggerless, NUM ticks from the latest event of the event instead\n\t--delayed=NUM\talso search the windows delayed by NUM ticks for accidental coincidences (can be repeated)\n\t--delayed-output=FILE\twrite the accidental coincidences to FILE, preceded by the delay\n\t--histogram-bins=NUM\tuse at most NUM bins in the time difference histograms (default 65536)\n\t--histogram-width=NUM\ttime difference histogram bins are NUM ticks wide (default 1, wider if needed)\n\t--histogram-log\tlogarithmic time difference histogram bins\n\t--spectrum=ADC,FILE\twrite the channel spectrum of ADC in the coincidences to FILE (binary, see coinc_spectra.h)\n\t--matrix=ADC,ADC,FILE\twrite the channel-channel matrix of two ADCs to FILE\n\t--timediff-matrix=ADC,FILE\twrite the channel-time difference matrix of ADC to FILE\n\t--channels=NUM\tchannels in spectra and matrices go from 0 to NUM-1 (default 8192)\n\t--matrix-bins=NUM\tuse at most NUM bins per matrix axis (default 1024)\n\t--rules=FILE\tsearch the coincidences defined in FILE in one pass, the other options are defaults for them (see coinc_rules.h)\n\t--flush-interval=NUM\tflush output after every NUM coincidences (default: only when the output buffer is full)\n\t--stats=FILE\twrite the statistics and the time taken by each stage to FILE (JSON)\n\t--index\twrite the timestamp index of the input file to infile.cidx while reading it\n\t--from-time=NUM\tsearch the triggers from timestamp NUM on, starting with the index of the input file (built if needed)\n\t--to-time=NUM\tsearch the triggers before timestamp NUM\n\t--checkpoint=FILE\tsave the state of the run to FILE every --checkpoint-interval seconds\n\t--checkpoint-interval=NUM\tsave a checkpoint every NUM seconds (default 600)\n\t--resume\tcontinue from the --checkpoint FILE (if there is one), appending to the output\n\n"
 #define  LICENCE_TEXT "This program is free software; you can redistribute it and/or modify\nit under the terms of the GNU General Public License as published by\nthe Free Software Foundation; either version 2 of the License, or\n(at your option) any later version.\n\nThis program is distributed in the hope that it will be useful,\nbut WITHOUT ANY WARRANTY; without even the implied warranty of\nMERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\nGNU General Public License for more details.\n"
 
 int verbose=0;
 int silent=0;
 
-struct list_event {
-    int adc;
-    int channel;
-    unsigned long long int timestamp;
+/* Opens the input (to follow it if follow is set), checks the binary header and skips the header line of text input
+ * and skip_lines more */
+input_t *open_input(const char *filename, input_format format, unsigned int skip_lines, unsigned int n_adcs, int follow) {
+    input_t *in=follow?input_open_follow(filename, format):input_open(filename, format);
+    const binary_header_t *binary_header;
+    if(!in) {
+        if(filename) {
+            fprintf(stderr, "Could not open file \"%s\" for input.\n", filename);
+        } else {
+            fprintf(stderr, "Error: input file could not be read.\n");
+        }
+        return NULL;
+    }
+    binary_header=input_binary_header(in);
+    if(binary_header) {
+        if(verbose) {
+            fprintf(stderr, "Binary input: %u ADCs, %llu ps per tick, %llu events (0 = unknown)\n", binary_header->n_adcs, (unsigned long long)binary_header->tick_ps, (unsigned long long)binary_header->n_events);
+        }
+        if(binary_header->n_adcs > n_adcs) {
+            fprintf(stderr, "Warning: input has %u ADCs, but only %u are processed. Consider increasing number of ADCs.\n", binary_header->n_adcs, n_adcs);
+        }
+    } else {
+        skip_lines++; /* The first line of text input is a header */
+    }
+    if(skip_lines && !input_skip(in, skip_lines)) {
+        fprintf(stderr, "Can't skip more lines than there are in the input!\n");
+        input_close(in);
+        return NULL;
+    }
+    return in;
+}
+
+struct input_spec { /* --input */
+    char *filename;
+    int adc_offset;
+    long long int timestamp_offset;
 };
 
-typedef struct list_event event;
+struct reader {
+    input_t *in; /* Single input, or */
+    merge_t *merge; /* several merged */
+    unsigned int n_adcs;
+    input_index_t *index; /* --index: built while reading, NULL if not */
+    int range; /* --from-time or --to-time: only triggers from range_begin to range_end-1 are searched */
+    unsigned long long int range_begin, range_end;
+    unsigned long long int halo_begin, halo_end; /* Events before halo_begin are skipped, the input ends at halo_end */
+};
+
+int read_event(void *context, event *event) {
+    struct reader *reader=context;
+    unsigned long long int offset;
+    if(reader->merge)
+        return merge_read_event(reader->merge, event);
+    if(!reader->index && !reader->range)
+        return input_read_adc_event(reader->in, event, reader->n_adcs);
+    while(1) {
+        offset=input_offset(reader->in);
+        if(!input_read_adc_event(reader->in, event, reader->n_adcs))
+            return 0;
+        if(reader->index && !index_add(reader->index, offset, event->timestamp)) {
+            fprintf(stderr, "Warning: could not allocate memory for the index of the input, it is not written.\n");
+            index_free(reader->index);
+            reader->index=NULL;
+        }
+        if(!reader->range)
+            return 1;
+        if(event->timestamp >= reader->halo_end) /* The windows of the last triggers have closed */
+            return 0;
+        if(event->timestamp >= reader->halo_begin)
+            return 1;
+    }
+}
 
-typedef enum OUTPUT_MODE_E {
-	MODE_RAW = 0,
-    MODE_TIMESTAMPS = 1,
-    MODE_TIME_AND_CHANNEL = 2,
-    MODE_TIMEDIFF_AND_CHANNEL = 3
-} output_mode;
+/* Events outside the --from-time..--to-time range are only partner candidates of the triggers in it */
+size_t push_events(coinc_t *coinc, const struct reader *reader, const event *events, size_t n) {
+    size_t i;
+    if(!reader->range)
+        return coinc_push(coinc, events, n);
+    for(i=0; i < n; i++) {
+        if(events[i].timestamp < reader->range_begin || events[i].timestamp >= reader->range_end) {
+            if(!coinc_push_halo(coinc, &events[i], 1))
+                break;
+        } else if(!coinc_push(coinc, &events[i], 1)) {
+            break;
+        }
+    }
+    return i;
+}
 
-struct monitor {
-   FILE *f;
-   event last_event;
-   unsigned int sum;
+/* The index of an input file, read from next to it or, if it is missing or stale (or rebuild is set), built and written
+ * there */
+input_index_t *load_index(const char *input_filename, input_format format, const input_t *in, int rebuild) {
+    char *filename=index_filename(input_filename);
+    input_index_t *idx=NULL;
+    if(!filename)
+        return NULL;
+    if(!rebuild)
+        idx=index_read(filename, input_size(in));
+    if(!idx) {
+        if(verbose) fprintf(stderr, "Indexing the input to %s.\n", filename);
+        idx=index_build(input_filename, format);
+        if(idx && !index_write(idx, filename, input_size(in)))
+            fprintf(stderr, "Warning: could not write the index to \"%s\".\n", filename);
+    }
+    free(filename);
+    return idx;
+}
+
+/* Moves the input forward to where the index says the events from timestamp on start. Returns 0 and stays where it was
+ * if the event there does not have the indexed timestamp: the input has been rewritten with the same size. */
+int seek_index(input_t *in, const input_index_t *idx, unsigned long long timestamp) {
+    unsigned long long start=input_offset(in), offset, found_timestamp;
+    event found;
+    offset=index_find(idx, timestamp, &found_timestamp);
+    if(offset <= start)
+        return 1;
+    if(input_seek(in, offset) == offset && input_read_event(in, &found) && found.timestamp == found_timestamp) {
+        input_seek(in, offset);
+        return 1;
+    }
+    input_seek_line(in, start);
+    return 0;
+}
+
+struct writer {
+    output_t *out; /* Text output, or */
+    columnar_writer_t *columnar; /* columnar output, or */
+    FILE *spill; /* raw coincidences, to be written out later (see struct chunk_sink), or none of these */
+    spectra_t *spectra; /* NULL if there are none */
+    unsigned int n_adcs;
+    output_mode mode;
+    int triggertime;
+    monitor_cursor_t monitors[MONITORS_MAX]; /* Counted at the trigger of every coincidence written */
+    unsigned int n_monitors;
+    unsigned int flush_interval;
+    unsigned long long int n_written;
+    int follow; /* Keep track of coincidences not flushed yet */
+    int unflushed;
+    unsigned long long int flush_at; /* Trigger timestamp of the first coincidence not flushed yet */
 };
 
-typedef struct monitor monitor_t;
+void set_writer_monitors(struct writer *writer, monitor_t **monitors, unsigned int n_monitors) {
+    unsigned int i;
+    for(i=0; i < n_monitors; i++) {
+        monitor_cursor_init(&writer->monitors[i], monitors[i]);
+    }
+    writer->n_monitors=n_monitors;
+}
+
+/* Raw coincidence in the byte order of this computer, only for temporary files */
+int spill_coincidence(FILE *f, const coincidence_t *c) {
+    return fwrite(&c->trigger_timestamp, sizeof(c->trigger_timestamp), 1, f) == 1 &&
+        fwrite(c->present, sizeof(unsigned char), c->n_adcs, f) == c->n_adcs &&
+        fwrite(c->channel, sizeof(int), c->n_adcs, f) == c->n_adcs &&
+        fwrite(c->timestamp, sizeof(unsigned long long int), c->n_adcs, f) == c->n_adcs &&
+        fwrite(c->timediff, sizeof(long long int), c->n_adcs, f) == c->n_adcs;
+}
+
+int unspill_coincidence(FILE *f, coincidence_t *c) { /* c->n_adcs must be set. Returns 0 at the end of f. */
+    memset(c->monitor, 0, sizeof(c->monitor));
+    return fread(&c->trigger_timestamp, sizeof(c->trigger_timestamp), 1, f) == 1 &&
+        fread(c->present, sizeof(unsigned char), c->n_adcs, f) == c->n_adcs &&
+        fread(c->channel, sizeof(int), c->n_adcs, f) == c->n_adcs &&
+        fread(c->timestamp, sizeof(unsigned long long int), c->n_adcs, f) == c->n_adcs &&
+        fread(c->timediff, sizeof(long long int), c->n_adcs, f) == c->n_adcs;
+}
+
+int write_coincidence(void *context, coincidence_t *c) {
+    struct writer *writer=context;
+    unsigned int i;
+    if(writer->spectra) {
+        spectra_fill(writer->spectra, c);
+    }
+    if(writer->spill) {
+        return spill_coincidence(writer->spill, c);
+    }
+    for(i=0; i < writer->n_monitors; i++) {
+        c->monitor[i]=monitor_count(&writer->monitors[i], c->trigger_timestamp);
+    }
+    writer->n_written++;
+    if(writer->follow && !writer->unflushed) {
+        writer->unflushed=1;
+        writer->flush_at=c->trigger_timestamp;
+    }
+    if(writer->columnar) {
+        return columnar_writer_write(writer->columnar, c);
+    }
+    if(!writer->out)
+        return 1;
+    output_coincidence(writer->out, writer->mode, writer->triggertime, writer->n_monitors, c);
+    if(writer->flush_interval && !(writer->n_written%writer->flush_interval))
+        output_flush(writer->out);
+    return 1;
+}
 
-void insert_blank_event(event *event) {
-    event->adc=N_ADCS_MAX-1;
-    event->channel=-1;
-    event->timestamp=0;
+/* Accidental coincidences of the delayed windows, each line starting with the delay */
+struct delayed_writer {
+    struct writer writer;
+    const engine_config_t *config;
+};
+
+int write_delayed_coincidence(void *context, unsigned int delay_index, coincidence_t *c) {
+    struct delayed_writer *delayed=context;
+    output_int(delayed->writer.out, delayed->config->delay[delay_index], 7);
+    output_char(delayed->writer.out, ' ');
+    return write_coincidence(&delayed->writer, c);
 }
 
-monitor_t *init_monitor(char *filename) {
-    monitor_t *mon=malloc(sizeof(monitor_t));
-    mon->f=fopen(filename, "r");
-    if(!mon->f) {
-        free(mon);
+/* Coincidences go to the writer directly or through the pipeline */
+struct emitter {
+    struct writer *writer;
+    pipeline_t *pipeline;
+    unsigned long long int n_emitted;
+    unsigned long long int n_max; /* Stop after this many, 0 for no limit */
+};
+
+int emit_coincidence(void *context, coincidence_t *c) {
+    struct emitter *emitter=context;
+    if(emitter->pipeline) {
+        pipeline_write(emitter->pipeline, c);
+    } else {
+        write_coincidence(emitter->writer, c);
+    }
+    emitter->n_emitted++;
+    return emitter->n_emitted != emitter->n_max;
+}
+
+/* Opens an existing output file to continue it after its first size bytes, anything after them is discarded (--resume) */
+FILE *reopen_output(const char *filename, long long int size) {
+#ifdef HAVE_FTRUNCATE
+    FILE *f=fopen(filename, "r+");
+    if(!f)
+        return NULL;
+    if(ftruncate(fileno(f), (off_t)size) || fseek(f, 0, SEEK_END)) {
+        fclose(f);
         return NULL;
     }
-    mon->last_event.adc=0;
-    mon->last_event.channel=0;
-    mon->last_event.timestamp=0;
-    mon->sum=0;
-    return mon;
+    return f;
+#else
+    (void)filename;
+    (void)size;
+    return NULL;
+#endif
 }
 
-int advance_monitorfile_until_timestamp(monitor_t *mon, unsigned long long int ts) {
-    while(ts > mon->last_event.timestamp) { /* This will actually go one too far (how else are we going to know when to stop? */
-        if(fscanf(mon->f,"%i %i %llu\n",&(mon->last_event.adc), &(mon->last_event.channel), &(mon->last_event.timestamp)) == 3) {
-            mon->sum++;
-        } else {
-            return (mon->sum-1);
+/* Opens the output file (standard output if filename is NULL or "-") and a writer in the given OUTPUT_FORMAT_* on it.
+ * A text output file is continued after resume_size bytes if it is not negative. mode, triggertime, monitors, spectra
+ * and flush_interval of writer must be set. Returns NULL on failure. */
+FILE *open_writer(struct writer *writer, const char *filename, int format, const engine_config_t *config, long long int resume_size) {
+    FILE *f=stdout;
+    if(filename && strcmp(filename, "-") != 0 && format != OUTPUT_FORMAT_NONE) {
+        f=(resume_size >= 0)?reopen_output(filename, resume_size):fopen(filename, (format == OUTPUT_FORMAT_COLUMNAR)?"wb":"w");
+        if(!f) {
+            fprintf(stderr, "Could not open file \"%s\" for output.\n", filename);
+            return NULL;
         }
     }
-    return (mon->sum-1);
+    writer->n_written=0;
+    writer->follow=0;
+    writer->unflushed=0;
+    writer->out=NULL;
+    writer->columnar=NULL;
+    writer->spill=NULL;
+    writer->n_adcs=config->n_adcs;
+    if(format == OUTPUT_FORMAT_COLUMNAR && writer->n_monitors > 1) {
+        fprintf(stderr, "Columnar output has only one monitor column, give a single --monitor.\n");
+        if(f != stdout)
+            fclose(f);
+        return NULL;
+    }
+    if(format == OUTPUT_FORMAT_NONE)
+        return f;
+    if(format == OUTPUT_FORMAT_COLUMNAR) {
+        writer->columnar=columnar_writer_open(f, config->n_adcs, (config->trigger_adc == ENGINE_TRIGGERLESS)?COLUMNAR_NO_TRIGGER:(unsigned int)config->trigger_adc, COLUMNAR_CHUNK_ROWS_DEFAULT, writer->n_monitors?COLUMNAR_FLAG_MONITOR:0);
+    } else {
+        writer->out=output_open(f);
+    }
+    if(!writer->out && !writer->columnar) {
+        fprintf(stderr, "Could not allocate memory for the output buffer.\n");
+        if(f != stdout)
+            fclose(f);
+        return NULL;
+    }
+    return f;
 }
 
+int close_writer(struct writer *writer, FILE *f) { /* Returns 0 if any write failed */
+    int ok=output_close(writer->out);
+    ok=columnar_writer_close(writer->columnar) && ok;
+    return (f == stdout || fclose(f) == 0) && ok;
+}
 
-int read_event_from_file(FILE *file, event *event, int n_adcs) {
-    if(fscanf(file,"%i %i %llu\n",&event->adc, &event->channel, &event->timestamp) == 3) {
-        if(event->adc < n_adcs && event->adc>=0) {
-            return 1;
+/* With --parallel every chunk of the input is written to a temporary file, which is appended to the output when the
+ * chunks before it are done. Text is formatted in the workers, each counting the monitors from the beginning with its
+ * own cursors. Columnar output is spilled raw and written through the single columnar writer, which also counts the
+ * monitors then. */
+struct chunk_output {
+    struct writer *writer; /* Final output */
+    spectra_t *spectra; /* Of the chunks merged so far, NULL if there are none */
+    monitor_t **monitors;
+    unsigned int n_monitors;
+    const engine_stats_t *stats; /* Of the chunks merged so far */
+};
+
+struct chunk_sink {
+    struct writer writer;
+    FILE *f; /* NULL if there is no output */
+};
+
+void discard_chunk_sink(void *context, void *sink_pointer) {
+    struct chunk_sink *sink=sink_pointer;
+    (void)context;
+    output_close(sink->writer.out);
+    spectra_free(sink->writer.spectra);
+    if(sink->f)
+        fclose(sink->f);
+    free(sink);
+}
+
+void *open_chunk_sink(void *context) {
+    struct chunk_output *output=context;
+    struct chunk_sink *sink=calloc(1, sizeof(struct chunk_sink));
+    if(!sink)
+        return NULL;
+    sink->writer=*output->writer;
+    sink->writer.out=NULL;
+    sink->writer.columnar=NULL;
+    sink->writer.flush_interval=0;
+    sink->writer.n_written=0;
+    sink->writer.spectra=NULL;
+    set_writer_monitors(&sink->writer, output->monitors, output->n_monitors);
+    if(output->spectra) {
+        sink->writer.spectra=spectra_create_empty(output->spectra);
+        if(!sink->writer.spectra) {
+            discard_chunk_sink(context, sink);
+            return NULL;
+        }
+    }
+    if(!output->writer->out && !output->writer->columnar)
+        return sink;
+    sink->f=tmpfile();
+    if(sink->f && output->writer->columnar) {
+        sink->writer.spill=sink->f;
+        return sink;
+    }
+    if(sink->f)
+        sink->writer.out=output_open(sink->f);
+    if(!sink->writer.out) {
+        discard_chunk_sink(context, sink);
+        return NULL;
+    }
+    return sink;
+}
+
+int merge_chunk_sink(void *context, void *sink_pointer) {
+    struct chunk_output *output=context;
+    struct chunk_sink *sink=sink_pointer;
+    unsigned char present[N_ADCS_MAX];
+    int channel[N_ADCS_MAX];
+    unsigned long long int timestamp[N_ADCS_MAX];
+    long long int timediff[N_ADCS_MAX];
+    coincidence_t c;
+    int ok=1;
+    if(sink->writer.out) {
+        ok=output_close(sink->writer.out);
+        sink->writer.out=NULL;
+    }
+    if(output->spectra)
+        spectra_add(output->spectra, sink->writer.spectra);
+    if(ok && sink->f && fseek(sink->f, 0, SEEK_SET))
+        ok=0;
+    if(!sink->f) {
+        /* Nothing to write */
+    } else if(ok && output->writer->columnar) {
+        c.n_adcs=sink->writer.n_adcs;
+        c.present=present;
+        c.channel=channel;
+        c.timestamp=timestamp;
+        c.timediff=timediff;
+        while(ok && unspill_coincidence(sink->f, &c)) {
+            ok=write_coincidence(output->writer, &c);
+        }
+        ok=ok && !ferror(sink->f);
+    } else if(ok) {
+        ok=output_append(output->writer->out, sink->f);
+    }
+    if(!silent) {
+        fprintf(stderr,"%10llu LINES READ: %10llu coincs\r", output->stats->n_events, output->stats->n_coincidences);
+    }
+    discard_chunk_sink(context, sink);
+    return ok;
+}
+
+/* Warnings and the table of counts and time difference limits per ADC */
+void print_summary(const engine_stats_t *stats, const engine_config_t *config) {
+    unsigned int adc, i;
+    double accidentals=0.0;
+    if(stats->n_truncated) {
+        fprintf(stderr, "Warning: the windows of %llu triggers were truncated because the coinc table was full. Consider increasing the table size.\n", stats->n_truncated);
+    }
+    if(stats->n_out_of_order) {
+        fprintf(stderr, "Warning: %llu events were not in time order. Coincidences with them may have been missed.\n", stats->n_out_of_order);
+    }
+    fprintf(stderr, "--------------------------------------------------------------------\n");
+    fprintf(stderr, "ADC     Total  In coinc   %% of   %% of     1%%      5%%     95%%     99%%\n");
+    fprintf(stderr, "                         these coincs  limit   limit   limit   limit\n");
+    fprintf(stderr, "--------------------------------------------------------------------\n");
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if(stats->n_adc_events[adc]) {
+            fprintf(stderr, "%3i %9llu %9llu %5.1f%% %5.1f%%", adc, stats->n_adc_events[adc], stats->n_coinc_adc_events[adc], stats->n_coinc_adc_events[adc]/(0.01*stats->n_adc_events[adc]), stats->n_coinc_adc_events[adc]/(0.01*stats->n_coincidences));
+            fprintf(stderr, "%7lli %7lli %7lli %7lli\n",
+                coinc_histogram_percentile(&stats->timediff_histogram[adc], 0.01),
+                coinc_histogram_percentile(&stats->timediff_histogram[adc], 0.05),
+                coinc_histogram_percentile(&stats->timediff_histogram[adc], 0.95),
+                coinc_histogram_percentile(&stats->timediff_histogram[adc], 0.99)
+            );
+        }
+    }
+    fprintf(stderr, "--------------------------------------------------------------------\n");
+    if(!config->n_delays)
+        return;
+    for(i=0; i < config->n_delays; i++) {
+        fprintf(stderr, "Delayed window %+lli: %llu accidental coincidences\n", config->delay[i], stats->n_delayed_coincidences[i]);
+        accidentals+=stats->n_delayed_coincidences[i];
+    }
+    accidentals/=config->n_delays;
+    fprintf(stderr, "Estimated accidental coincidences: %.1f (%.2f%% of coincidences, %.3g per trigger)\n", accidentals,
+            stats->n_coincidences?accidentals/(0.01*stats->n_coincidences):0.0,
+            stats->n_adc_events[config->trigger_adc]?accidentals/stats->n_adc_events[config->trigger_adc]:0.0);
+    fprintf(stderr, "ADC  Accidental events\n");
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if(stats->n_coinc_adc_events[adc] || stats->n_delayed_adc_events[adc])
+            fprintf(stderr, "%3i %12.1f\n", adc, (double)stats->n_delayed_adc_events[adc]/config->n_delays);
+    }
+    fprintf(stderr, "--------------------------------------------------------------------\n");
+}
+
+/* --snapshot-interval: the summary is printed and the --stats file rewritten every interval seconds while the input is
+ * being read */
+struct snapshots {
+    unsigned int interval; /* 0 for none */
+    time_t next;
+    const char *stats_filename; /* NULL if there is none */
+    const stats_timer_t *timer;
+};
+
+void take_snapshot(struct snapshots *snapshots, coinc_t *coinc) {
+    const engine_stats_t *stats=coinc_stats(coinc);
+    if(!snapshots->interval || time(NULL) < snapshots->next)
+        return;
+    fprintf(stderr, "\n%10llu LINES READ: %10llu coincs so far\n", stats->n_events, stats->n_coincidences);
+    print_summary(stats, coinc_config(coinc));
+    if(snapshots->stats_filename && !stats_write(snapshots->stats_filename, stats, coinc_config(coinc), snapshots->timer, 0))
+        fprintf(stderr, "Warning: could not write statistics to \"%s\".\n", snapshots->stats_filename);
+    snapshots->next=time(NULL)+snapshots->interval;
+}
+
+/* --checkpoint: every interval seconds the position in the input and the outputs and the state of the search are saved,
+ * between two events so that everything found so far has been written. --resume truncates the outputs back to the
+ * saved sizes and continues from there. */
+struct checkpoints {
+    const char *filename; /* NULL for none */
+    unsigned int interval;
+    time_t next;
+    const struct reader *reader;
+    const struct emitter *emitter;
+    struct writer *writer, *delayed; /* delayed is NULL if there is no delayed output */
+    FILE *output_file, *delayed_file;
+};
+
+void save_output_position(struct checkpoint_output *output, struct writer *writer, FILE *f) {
+    unsigned int i;
+    output->size=-1;
+    if(writer->out) {
+        output_flush(writer->out);
+        output->size=ftell(f);
+    }
+    output->n_written=writer->n_written;
+    for(i=0; i < writer->n_monitors; i++) {
+        output->monitor_position[i]=writer->monitors[i].position;
+        output->monitor_last_timestamp[i]=writer->monitors[i].last_timestamp;
+    }
+}
+
+void restore_output_position(struct writer *writer, const struct checkpoint_output *output) {
+    unsigned int i;
+    writer->n_written=output->n_written;
+    for(i=0; i < writer->n_monitors; i++) {
+        writer->monitors[i].position=output->monitor_position[i];
+        writer->monitors[i].last_timestamp=output->monitor_last_timestamp[i];
+    }
+}
+
+void take_checkpoint(struct checkpoints *checkpoints, coinc_t *coinc) {
+    checkpoint_t cp;
+    if(!checkpoints->filename || time(NULL) < checkpoints->next)
+        return;
+    memset(&cp, 0, sizeof(checkpoint_t));
+    cp.input_size=input_size(checkpoints->reader->in);
+    cp.input_offset=input_offset(checkpoints->reader->in);
+    cp.n_emitted=checkpoints->emitter->n_emitted;
+    cp.n_monitors=checkpoints->writer->n_monitors;
+    save_output_position(&cp.output, checkpoints->writer, checkpoints->output_file);
+    cp.delayed_output.size=-1;
+    if(checkpoints->delayed)
+        save_output_position(&cp.delayed_output, checkpoints->delayed, checkpoints->delayed_file);
+    if(!checkpoint_write(checkpoints->filename, &cp, coinc))
+        fprintf(stderr, "\nWarning: could not write checkpoint \"%s\".\n", checkpoints->filename);
+    if(verbose) fprintf(stderr, "\nCheckpoint at input offset %llu.\n", cp.input_offset);
+    checkpoints->next=time(NULL)+checkpoints->interval;
+}
+
+/* --follow: the input keeps coming until a pipe is closed or the program is interrupted. A coincidence is flushed out
+ * once the input has passed its trigger by flush_delay ticks (the reach of the windows plus --latency), and everything
+ * is flushed whenever the input pauses. */
+volatile sig_atomic_t follow_stopped=0;
+
+void stop_following(int signal_number) {
+    (void)signal_number;
+    follow_stopped=1;
+}
+
+void flush_writers(struct writer *writer, struct writer *delayed) {
+    if(writer->out)
+        output_flush(writer->out);
+    writer->unflushed=0;
+    if(delayed && delayed->out)
+        output_flush(delayed->out);
+}
+
+void follow_input(coinc_t *coinc, struct reader *reader, struct writer *writer, struct writer *delayed, unsigned long long int flush_delay, struct snapshots *snapshots) {
+    const engine_stats_t *stats=coinc_stats(coinc);
+    event new_event;
+    int got_event;
+    signal(SIGINT, stop_following);
+    signal(SIGTERM, stop_following);
+    while(!follow_stopped) {
+        got_event=read_event(reader, &new_event);
+        if(got_event) {
+            if(!coinc_push(coinc, &new_event, 1))
+                break;
+            if(writer->unflushed && new_event.timestamp > writer->flush_at && new_event.timestamp-writer->flush_at > flush_delay)
+                flush_writers(writer, delayed);
+            if(stats->n_events%1000)
+                continue;
+            if(!silent)
+                fprintf(stderr,"%10llu LINES READ: %10llu coincs\r", stats->n_events, stats->n_coincidences);
+        } else if(!input_waiting(reader->in)) {
+            break;
         } else {
-            fprintf(stderr, "ADC value %u too high or negative, aborting. Check input file or try increasing number of ADCs (currently %i).\n", event->adc, n_adcs);
-            return 0;
+            flush_writers(writer, delayed);
         }
+        take_snapshot(snapshots, coinc);
+        if(!got_event)
+            input_wait(reader->in, FOLLOW_WAIT_MS);
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+}
 
-    } else {
-		if(!feof(file)) {
-			fprintf(stderr, "\nError in input data.\n");
-		}
-		return 0;
-	}
+/* --stats in a serial run: the input is read and searched in batches, and the coincidences are pulled from the search
+ * and written after each batch, so that the clocks are read only a few times per batch. The search must have no
+ * callback, and the emitter no --nevents limit, which would stop the search in the middle of a batch. Returns 0 if
+ * memory ran out. */
+int search_timed(coinc_t *coinc, struct reader *reader, struct emitter *emitter, stats_timer_t *timer, struct snapshots *snapshots, struct checkpoints *checkpoints) {
+    const engine_stats_t *stats=coinc_stats(coinc);
+    event *events=malloc(STATS_BATCH_EVENTS*sizeof(event));
+    const coincidence_t *pulled;
+    coincidence_t c;
+    size_t n;
+    int running=1;
+    if(!events)
+        return 0;
+    while(running) {
+        stats_timer_switch(timer, STATS_STAGE_PARSE);
+        for(n=0; n < STATS_BATCH_EVENTS && read_event(reader, &events[n]); n++);
+        stats_timer_switch(timer, STATS_STAGE_SEARCH);
+        if(n)
+            running=(push_events(coinc, reader, events, n) == n);
+        if(n < STATS_BATCH_EVENTS || !running) {
+            coinc_finish(coinc);
+            running=0;
+        }
+        stats_timer_switch(timer, STATS_STAGE_OUTPUT);
+        while((pulled=coinc_next(coinc))) {
+            c=*pulled; /* The monitor counts are filled in */
+            emit_coincidence(emitter, &c);
+        }
+        stats_timer_switch(timer, -1);
+        if(!silent)
+            fprintf(stderr,"%10llu LINES READ: %10llu coincs\r", stats->n_events, stats->n_coincidences);
+        take_snapshot(snapshots, coinc);
+        if(running)
+            take_checkpoint(checkpoints, coinc);
+    }
+    free(events);
+    return !coinc_failed(coinc);
 }
 
-int find_percentile(double percentile, unsigned int *histogram, int low, int high) {
-    unsigned int integral=0;
-    int i, i_max=high-low;
-    unsigned int stop=0;
-    for(i=0; i<=i_max; i++) {
-        integral += histogram[i];
-    }
-    stop=(unsigned int) (percentile*integral*1.0);
-    integral=0;
-    for(i=0; i<=i_max; i++) {
-        integral += histogram[i];
-        if(integral >= stop)
-            return (i+low);
-    }
-    return (low-1);
+/* --rules: every definition has its own engine and output, and every event read is pushed to all the engines */
+struct search {
+    const rule_t *rule;
+    coinc_t *coinc;
+    FILE *output_file;
+    struct writer writer;
+    struct emitter emitter;
+    int done; /* Stopped after --nevents coincidences */
+};
+
+int search_rules(const rule_t *rules, unsigned int n_rules, struct reader *reader, monitor_t **monitors, unsigned int n_monitors, unsigned int flush_interval, unsigned long long int n_max) {
+    struct search *searches=calloc(n_rules, sizeof(struct search)), *search;
+    unsigned long long int n_events=0;
+    unsigned int i, n_running=n_rules, n_stdout=0;
+    event new_event;
+    int ok=1;
+    if(!searches) {
+        fprintf(stderr, "Could not allocate memory for the coincidence definitions.\n");
+        return 0;
+    }
+    for(i=0; i < n_rules; i++) {
+        if(!rules[i].output_filename || strcmp(rules[i].output_filename, "-") == 0)
+            n_stdout++;
+    }
+    if(n_stdout > 1) {
+        fprintf(stderr, "Only one coincidence definition can be written to standard output, give the others an output file.\n");
+        free(searches);
+        return 0;
+    }
+    for(i=0; ok && i < n_rules; i++) { /* If one fails, the outputs opened before it are closed below */
+        search=&searches[i];
+        search->rule=&rules[i];
+        search->writer.mode=rules[i].mode;
+        search->writer.triggertime=rules[i].triggertime;
+        search->writer.flush_interval=flush_interval;
+        set_writer_monitors(&search->writer, monitors, n_monitors);
+        search->output_file=open_writer(&search->writer, rules[i].output_filename, rules[i].output_format, &rules[i].config, -1);
+        if(!search->output_file) {
+            ok=0;
+            break;
+        }
+        search->emitter.writer=&search->writer;
+        search->emitter.pipeline=NULL;
+        search->emitter.n_emitted=0;
+        search->emitter.n_max=n_max;
+        search->coinc=coinc_create(&rules[i].config);
+        if(!search->coinc) {
+            fprintf(stderr, "Could not allocate memory for the coinc table of \"%s\".\n", rules[i].name);
+            ok=0;
+            break;
+        }
+        coinc_set_callback(search->coinc, emit_coincidence, &search->emitter);
+        if(verbose) fprintf(stderr, "Coincidence definition \"%s\": trigger ADC %i, multiplicity %i, output to %s.\n", rules[i].name, rules[i].config.trigger_adc, rules[i].config.min_multiplicity, rules[i].output_filename?rules[i].output_filename:"standard output");
+    }
+    while(ok && n_running && read_event(reader, &new_event)) {
+        n_events++;
+        for(i=0; i < n_rules; i++) {
+            search=&searches[i];
+            if(!search->done && !coinc_push(search->coinc, &new_event, 1)) {
+                search->done=1;
+                n_running--;
+            }
+        }
+        if(!(n_events%1000) && !silent) {
+            fprintf(stderr,"%10llu LINES READ\r", n_events);
+        }
+    }
+    for(i=0; i < n_rules; i++) {
+        search=&searches[i];
+        if(!search->output_file) /* Not opened, setting up the definitions failed */
+            continue;
+        if(search->coinc)
+            coinc_finish(search->coinc);
+        if(search->coinc && coinc_failed(search->coinc)) {
+            fprintf(stderr, "\nCould not allocate memory for the coinc table of \"%s\".\n", search->rule->name);
+            ok=0;
+        }
+        if(!close_writer(&search->writer, search->output_file)) {
+            fprintf(stderr, "\nError writing output of \"%s\".\n", search->rule->name);
+            ok=0;
+        }
+    }
+    if(ok && !silent) {
+        fprintf(stderr,"%10llu LINES READ\nDone.\n", n_events);
+        for(i=0; i < n_rules; i++) {
+            search=&searches[i];
+            fprintf(stderr, "\n%s: %llu coincs\n", search->rule->name, coinc_stats(search->coinc)->n_coincidences);
+            print_summary(coinc_stats(search->coinc), coinc_config(search->coinc));
+        }
+    }
+    for(i=0; i < n_rules; i++) {
+        coinc_free(searches[i].coinc);
+    }
+    free(searches);
+    return ok;
 }
 
 int main (int argc, char **argv) {
     unsigned int i=0;
-    unsigned int j=0,k=0;
     unsigned int coinc_table_size=COINC_TABLE_SIZE_DEFAULT, coinc_table_size_argument;
-    unsigned int coincs_found=0;
-    unsigned int lines_read=0;
     int trigger_adc=TRIGGER_ADC_DEFAULT,trigger_adc_argument;
 	unsigned int n_adcs_argument=0,n_adcs=N_ADCS_DEFAULT;
 	int require_argument;
     int adc;
-	unsigned int adcs_in_coinc;
 	output_mode output_mode=MODE_RAW;
     int triggertime=0;
-	int *coinc_events, *n_adc_events, *n_coinc_adc_events;
-	long long int time_difference;
     long long int *time_window_high=malloc(N_ADCS_MAX*sizeof(long long int));
 	long long int *time_window_low=malloc(N_ADCS_MAX*sizeof(long long int));
     long long int time_window_argument=0;
     int *require = (int *)malloc(N_ADCS_MAX*(sizeof(int)));
-    int all_required_found;
     int min_multiplicity=MIN_MULTIPLICITY_DEFAULT;
     int adc_argument=0;
-	int endgame=0;
 	int skip_lines_argument=0,skip_lines=SKIP_LINES_DEFAULT;
     int output_n_events=0;
-    monitor_t *monitor=NULL;
-    char *monitorfilename=calloc(256, sizeof(char));
-	char buffer[100];
-	event *coinc_table;
+    monitor_t *monitors[MONITORS_MAX], *monitor;
+    unsigned int n_monitors=0;
+    event new_event;
+    engine_config_t config;
+    coinc_t *coinc;
+    const engine_stats_t *stats;
+    int threads=0;
+    unsigned int parallel=0;
+    unsigned long long int parallel_chunk_size=0;
+    unsigned long long int data_begin=0;
+    parallel_sink_t chunk_sink;
+    struct chunk_output chunk_output;
+    parallel_result parallel_result;
 
-    FILE *read_file=stdin;
+    input_t *read_file=NULL;
+    char *input_filename=NULL; /* Standard input is used if no input file is given */
+    input_format input_format=INPUT_FORMAT_TEXT;
+    struct input_spec inputs[N_INPUTS_MAX];
+    unsigned int n_inputs=0;
+    unsigned int timestamp_bits=0;
+    long long int offset_argument;
+    merge_t *merge=NULL;
+    input_t *merge_input;
+    unsigned long long int build_window=0;
+    int triggerless=0, build_extending=0;
+    long long int delays[ENGINE_DELAYS_MAX];
+    unsigned int n_delays=0;
+    char *delayed_filename=NULL;
+    struct delayed_writer delayed_writer;
+    FILE *delayed_file=NULL;
+    char *rules_filename=NULL;
+    rule_t *rules=NULL, rule_defaults;
+    unsigned int n_rules=0;
+    const char *kernel_name=NULL;
+    const window_kernel_t *kernel;
 	FILE *output_file=stdout;
-    unsigned int **timediff_histogram;
+    char *output_filename=NULL; /* Standard output is used if no output file is given */
+    int output_format=OUTPUT_FORMAT_TEXT;
+    spectrum_definition_t spectrum_definitions[SPECTRA_MAX];
+    unsigned int n_spectra=0;
+    long long int spectrum_channels=SPECTRUM_CHANNELS_DEFAULT;
+    unsigned int matrix_bins=SPECTRUM_MATRIX_BINS_DEFAULT;
+    spectra_t *spectra=NULL;
+    unsigned int histogram_bins=HISTOGRAM_BINS_DEFAULT;
+    long long int histogram_width=1;
+    int histogram_log=0;
+    int adc_y_argument, n_parsed;
+    unsigned int flush_interval=0;
+    struct reader reader;
+    struct writer writer;
+    struct emitter emitter;
+    int write_ok, rules_ok;
+    int follow=0;
+    unsigned long long int latency=0, flush_delay;
+    unsigned int snapshot_interval=0;
+    long long int reach_min, reach_max, reach;
+    char *stats_filename=NULL;
+    stats_timer_t stats_timer;
+    struct snapshots snapshots;
+    int timed=0;
+    int build_index=0;
+    input_index_t *index;
+    char *index_file;
+    unsigned long long int from_time=0, to_time=0, n_read=0;
+    int from_time_given=0, to_time_given=0;
+    char *checkpoint_filename=NULL;
+    unsigned int checkpoint_interval=CHECKPOINT_INTERVAL_DEFAULT;
+    int checkpoint_interval_given=0, resume=0;
+    checkpoint_t checkpoint;
+    struct checkpoints checkpoints;
+    FILE *checkpoint_file;
 
 
+    stats_timer_init(&stats_timer);
     if(argc==1) {
         fprintf(stderr, "coinc %s\n", coinc_VERSION);
 		fprintf(stderr, HELP_TEXT, argv[0]);
@@ -185,11 +870,215 @@ int main (int argc, char **argv) {
             if(verbose) fprintf(stderr, "Outputting also trigger timestamp (first column)\n");
             continue;
         }
-        if(sscanf(argv[i], "--monitor=%200s", monitorfilename)==1) {
-            if(verbose) fprintf(stderr, "Using file %s for monitor data\n", monitorfilename);
-            monitor=init_monitor(monitorfilename);
+        if(strncmp(argv[i], "--monitor=", 10)==0 && argv[i][10]) {
+            if(n_monitors == MONITORS_MAX) {
+                fprintf(stderr, "At most %i monitors are allowed.\n", MONITORS_MAX);
+                return 0;
+            }
+            monitor=monitor_open(argv[i]+10);
             if(!monitor) {
-                fprintf(stderr, "Could not open file %s! Monitor data ignored\n", monitorfilename);
+                fprintf(stderr, "Could not open file %s! Monitor data ignored\n", argv[i]+10);
+                continue;
+            }
+            if(verbose) fprintf(stderr, "Using file %s for monitor data (%llu events)\n", argv[i]+10, monitor_n_events(monitor));
+            monitors[n_monitors++]=monitor;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--input-format=bin")==0) {
+            input_format=INPUT_FORMAT_BINARY;
+            if(verbose) fprintf(stderr, "Reading binary list-mode input.\n");
+            continue;
+        }
+        if(strcmp(argv[i], "--input-format=text")==0) {
+            input_format=INPUT_FORMAT_TEXT;
+            continue;
+        }
+
+        if(strncmp(argv[i], "--input=", 8)==0) {
+            if(n_inputs == N_INPUTS_MAX) {
+                fprintf(stderr, "Too many inputs, at most %i can be merged.\n", N_INPUTS_MAX);
+                return 0;
+            }
+            inputs[n_inputs].filename=argv[i]+8;
+            inputs[n_inputs].adc_offset=0;
+            inputs[n_inputs].timestamp_offset=0;
+            n_inputs++;
+            continue;
+        }
+        if(sscanf(argv[i], "--adc-offset=%lli", &offset_argument)==1) {
+            if(!n_inputs) {
+                fprintf(stderr, "--adc-offset must follow the --input it applies to.\n");
+                return 0;
+            }
+            inputs[n_inputs-1].adc_offset=(int)offset_argument;
+            continue;
+        }
+        if(sscanf(argv[i], "--timestamp-offset=%lli", &offset_argument)==1) {
+            if(!n_inputs) {
+                fprintf(stderr, "--timestamp-offset must follow the --input it applies to.\n");
+                return 0;
+            }
+            inputs[n_inputs-1].timestamp_offset=offset_argument;
+            continue;
+        }
+        if(sscanf(argv[i], "--timestamp-bits=%u", &timestamp_bits)==1) {
+            if(timestamp_bits < 2 || timestamp_bits > MERGE_TIMESTAMP_BITS_MAX) {
+                fprintf(stderr, "Timestamps must have 2 to %i bits.\n", MERGE_TIMESTAMP_BITS_MAX);
+                return 0;
+            }
+            continue;
+        }
+
+        if(sscanf(argv[i], "--triggerless=%llu", &build_window)==1) {
+            triggerless=1;
+            continue;
+        }
+        if(sscanf(argv[i], "--delayed=%lli", &offset_argument)==1) {
+            if(n_delays == ENGINE_DELAYS_MAX) {
+                fprintf(stderr, "At most %i delayed windows are allowed.\n", ENGINE_DELAYS_MAX);
+                return 0;
+            }
+            delays[n_delays++]=offset_argument;
+            continue;
+        }
+        if(strncmp(argv[i], "--delayed-output=", 17)==0) {
+            delayed_filename=argv[i]+17;
+            continue;
+        }
+        if(strcmp(argv[i], "--extending")==0) {
+            build_extending=1;
+            continue;
+        }
+
+        if(strncmp(argv[i], "--rules=", 8)==0) {
+            rules_filename=argv[i]+8;
+            continue;
+        }
+
+        if(strncmp(argv[i], "--kernel=", 9)==0) {
+            kernel_name=argv[i]+9;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--output-format=columnar")==0) {
+            output_format=OUTPUT_FORMAT_COLUMNAR;
+            if(verbose) fprintf(stderr, "Writing columnar binary output.\n");
+            continue;
+        }
+        if(strcmp(argv[i], "--output-format=text")==0) {
+            output_format=OUTPUT_FORMAT_TEXT;
+            continue;
+        }
+        if(strcmp(argv[i], "--output-format=none")==0) {
+            output_format=OUTPUT_FORMAT_NONE;
+            continue;
+        }
+
+        if(sscanf(argv[i], "--histogram-bins=%u", &histogram_bins)==1) {
+            if(histogram_bins < 1) {
+                fprintf(stderr, "Histograms need at least one bin.\n");
+                return 0;
+            }
+            continue;
+        }
+        if(sscanf(argv[i], "--histogram-width=%lli", &histogram_width)==1) {
+            if(histogram_width < 1) {
+                fprintf(stderr, "Histogram bins must be at least one tick wide.\n");
+                return 0;
+            }
+            continue;
+        }
+        if(strcmp(argv[i], "--histogram-log")==0) {
+            histogram_log=1;
+            continue;
+        }
+        if(sscanf(argv[i], "--channels=%lli", &spectrum_channels)==1) {
+            if(spectrum_channels < 1) {
+                fprintf(stderr, "Spectra need at least one channel.\n");
+                return 0;
+            }
+            continue;
+        }
+        if(sscanf(argv[i], "--matrix-bins=%u", &matrix_bins)==1) {
+            if(matrix_bins < 1) {
+                fprintf(stderr, "Matrices need at least one bin per axis.\n");
+                return 0;
+            }
+            continue;
+        }
+        n_parsed=0;
+        if((sscanf(argv[i], "--spectrum=%i,%n", &adc_argument, &n_parsed)==1 && n_parsed && argv[i][n_parsed]) ||
+           (sscanf(argv[i], "--timediff-matrix=%i,%n", &adc_argument, &n_parsed)==1 && n_parsed && argv[i][n_parsed]) ||
+           (sscanf(argv[i], "--matrix=%i,%i,%n", &adc_argument, &adc_y_argument, &n_parsed)==2 && n_parsed && argv[i][n_parsed])) {
+            if(n_spectra == SPECTRA_MAX) {
+                fprintf(stderr, "At most %i spectra and matrices are allowed.\n", SPECTRA_MAX);
+                return 0;
+            }
+            spectrum_definitions[n_spectra].type=(argv[i][2] == 's')?SPECTRUM_CHANNELS:((argv[i][2] == 't')?SPECTRUM_TIMEDIFF_MATRIX:SPECTRUM_MATRIX);
+            spectrum_definitions[n_spectra].adc_x=adc_argument;
+            spectrum_definitions[n_spectra].adc_y=(spectrum_definitions[n_spectra].type == SPECTRUM_MATRIX)?adc_y_argument:adc_argument;
+            spectrum_definitions[n_spectra].filename=argv[i]+n_parsed;
+            n_spectra++;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--follow")==0) {
+            follow=1;
+            continue;
+        }
+        if(sscanf(argv[i], "--latency=%llu", &latency)==1) {
+            continue;
+        }
+        if(sscanf(argv[i], "--snapshot-interval=%u", &snapshot_interval)==1) {
+            continue;
+        }
+
+        if(strncmp(argv[i], "--stats=", 8)==0 && argv[i][8]) {
+            stats_filename=argv[i]+8;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--index")==0) {
+            build_index=1;
+            continue;
+        }
+        if(sscanf(argv[i], "--from-time=%llu", &from_time)==1) {
+            from_time_given=1;
+            continue;
+        }
+        if(sscanf(argv[i], "--to-time=%llu", &to_time)==1) {
+            to_time_given=1;
+            continue;
+        }
+        if(strncmp(argv[i], "--checkpoint=", 13)==0 && argv[i][13]) {
+            checkpoint_filename=argv[i]+13;
+            continue;
+        }
+        if(sscanf(argv[i], "--checkpoint-interval=%u", &checkpoint_interval)==1) {
+            checkpoint_interval_given=1;
+            continue;
+        }
+        if(strcmp(argv[i], "--resume")==0) {
+            resume=1;
+            continue;
+        }
+
+        if(strcmp(argv[i], "--threads")==0) {
+            threads=1;
+            continue;
+        }
+        if(sscanf(argv[i], "--parallel-chunk-size=%llu", &parallel_chunk_size)==1) {
+            if(parallel_chunk_size < 1) {
+                fprintf(stderr, "Chunk size must be at least 1 byte!\n");
+                return 0;
+            }
+            continue;
+        }
+        if(sscanf(argv[i], "--parallel=%u", &parallel)==1) {
+            if(parallel < 1) {
+                fprintf(stderr, "Number of threads must be at least 1!\n");
+                return 0;
             }
             continue;
         }
@@ -285,6 +1174,11 @@ int main (int argc, char **argv) {
             continue;
         }
 
+        if(sscanf(argv[i], "--flush-interval=%u", &flush_interval)==1) {
+            if(verbose) fprintf(stderr, "Flushing output after every %u coincidences.\n", flush_interval);
+            continue;
+        }
+
         if(sscanf(argv[i], "--nevents=%i", &output_n_events)==1) {
             if(output_n_events < 0) {
                 output_n_events=0;
@@ -309,226 +1203,489 @@ int main (int argc, char **argv) {
 			return 0;
 		}
         if(strcmp(argv[i], "-")==0) {
-            if(read_file!=stdin) {
-                read_file=stdin;
+            if(input_filename) {
+                input_filename=NULL;
             } else {
-                output_file=stdout;
+                output_filename=NULL;
             }
             continue;
         }
 
-		if(read_file != stdin) { /* Reading from file already, this parameter must be output filename */
+		if(input_filename) { /* Reading from file already, this parameter must be output filename */
 			if(verbose) fprintf(stderr, "Assuming argument no %i \"%s\" is output filename\n",i,argv[i]); 
 			fflush(stderr);
-			output_file=fopen(argv[i], "w");
-			if(!output_file) {
-				fprintf(stderr, "Could not open file \"%s\" for output.\n", argv[i]);
-				return 0;
-			}
+			output_filename=argv[i];
 		} else { /* This parameter is interpret as input filename */
 			if(verbose) fprintf(stderr, "Assuming argument no %i \"%s\" is input filename\n",i,argv[i]);
 			fflush(stderr);
-			read_file=fopen(argv[i],"r");
-			if(!read_file) {
-				fprintf(stderr, "Could not open file \"%s\" for input.\n", argv[i]);
-				return 0;
-			}
+			input_filename=argv[i];
 		}
 		
  	}
 
 
-	if(trigger_adc >= n_adcs) {
+    kernel=coinc_kernel_select(kernel_name);
+    if(!kernel) {
+        fprintf(stderr, "Window search kernel \"%s\" is not available on this computer.\n", kernel_name);
+        return 0;
+    }
+    if(verbose) fprintf(stderr, "Using %s window search kernel.\n", kernel->name);
+    if((threads && !pipeline_available()) || (parallel && !parallel_available())) {
+        fprintf(stderr, "Threads are not supported in this build of coinc.\n");
+        return 0;
+    }
+    if(follow && !input_follow_available()) {
+        fprintf(stderr, "--follow is not supported in this build of coinc.\n");
+        return 0;
+    }
+    if(follow && (threads || parallel || rules_filename || n_inputs || timestamp_bits)) {
+        fprintf(stderr, "--follow can't be used with --threads, --parallel, --rules, --input or --timestamp-bits.\n");
+        return 0;
+    }
+    if(follow && output_format == OUTPUT_FORMAT_COLUMNAR) {
+        fprintf(stderr, "--follow needs text output (or none), columnar output is written in chunks.\n");
+        return 0;
+    }
+    if(latency && !follow) {
+        fprintf(stderr, "--latency needs --follow.\n");
+        return 0;
+    }
+    if(snapshot_interval && !follow && !stats_filename) {
+        fprintf(stderr, "--snapshot-interval needs --follow or --stats.\n");
+        return 0;
+    }
+    if(parallel_chunk_size && !parallel) {
+        fprintf(stderr, "--parallel-chunk-size needs --parallel.\n");
+        return 0;
+    }
+    if(snapshot_interval && parallel) {
+        fprintf(stderr, "--snapshot-interval can't be used with --parallel.\n");
+        return 0;
+    }
+    if(stats_filename && rules_filename) {
+        fprintf(stderr, "--stats can't be used with --rules.\n");
+        return 0;
+    }
+    if(parallel && output_n_events) {
+        fprintf(stderr, "Warning: --nevents needs a serial run, --parallel is ignored.\n");
+        parallel=0;
+    }
+    if(parallel)
+        threads=0; /* The workers are threads already */
+    if(rules_filename && (threads || parallel)) {
+        fprintf(stderr, "--threads and --parallel can't be used with --rules.\n");
+        return 0;
+    }
+    if(triggerless && parallel) {
+        fprintf(stderr, "--parallel can't be used with --triggerless, events are built in one pass.\n");
+        return 0;
+    }
+    if(delayed_filename && !n_delays) {
+        fprintf(stderr, "--delayed-output needs --delayed.\n");
+        return 0;
+    }
+    if(n_delays && triggerless) {
+        fprintf(stderr, "--delayed can't be used with --triggerless.\n");
+        return 0;
+    }
+    if(delayed_filename && (parallel || rules_filename)) {
+        fprintf(stderr, "--delayed-output can't be used with --parallel or --rules.\n");
+        return 0;
+    }
+    if(delayed_filename && output_format != OUTPUT_FORMAT_TEXT) {
+        fprintf(stderr, "--delayed-output is text only.\n");
+        return 0;
+    }
+    for(i=0; i < n_spectra; i++) {
+        if(spectrum_definitions[i].adc_x < 0 || spectrum_definitions[i].adc_x >= n_adcs || spectrum_definitions[i].adc_y < 0 || spectrum_definitions[i].adc_y >= n_adcs) {
+            fprintf(stderr, "ADC of spectrum \"%s\" too high or negative.\n", spectrum_definitions[i].filename);
+            return 0;
+        }
+    }
+    if(n_spectra && rules_filename) {
+        fprintf(stderr, "Spectra can't be used with --rules.\n");
+        return 0;
+    }
+    if(build_extending && !triggerless) {
+        fprintf(stderr, "--extending needs --triggerless.\n");
+        return 0;
+    }
+    if((from_time_given || to_time_given || build_index) && (parallel || follow || rules_filename || n_inputs || timestamp_bits)) {
+        fprintf(stderr, "--index, --from-time and --to-time can't be used with --parallel, --follow, --rules, --input or --timestamp-bits.\n");
+        return 0;
+    }
+    if((from_time_given || to_time_given) && triggerless) {
+        fprintf(stderr, "--from-time and --to-time can't be used with --triggerless.\n");
+        return 0;
+    }
+    if(from_time_given && to_time_given && to_time <= from_time) {
+        fprintf(stderr, "--to-time must be later than --from-time.\n");
+        return 0;
+    }
+    if(build_index && skip_lines) {
+        fprintf(stderr, "--index needs the whole input, it can't be used with --skip.\n");
+        return 0;
+    }
+    if(build_index && !input_filename) {
+        fprintf(stderr, "--index needs an input file, the index is written next to it.\n");
+        return 0;
+    }
+    if((checkpoint_interval_given || resume) && !checkpoint_filename) {
+        fprintf(stderr, "--checkpoint-interval and --resume need --checkpoint.\n");
+        return 0;
+    }
+    if(checkpoint_filename && (threads || parallel || follow || rules_filename || n_inputs || timestamp_bits)) {
+        fprintf(stderr, "--checkpoint can't be used with --threads, --parallel, --follow, --rules, --input or --timestamp-bits.\n");
+        return 0;
+    }
+    if(checkpoint_filename && (output_format == OUTPUT_FORMAT_COLUMNAR || n_spectra)) {
+        fprintf(stderr, "--checkpoint needs text output (or none) and no spectra.\n");
+        return 0;
+    }
+    if(checkpoint_filename && output_format == OUTPUT_FORMAT_TEXT && (!output_filename || strcmp(output_filename, "-") == 0 || (delayed_filename && strcmp(delayed_filename, "-") == 0))) {
+        fprintf(stderr, "--checkpoint needs the output in a file, standard output can't be resumed.\n");
+        return 0;
+    }
+#ifndef HAVE_FTRUNCATE
+    if(resume) {
+        fprintf(stderr, "--resume is not supported in this build of coinc.\n");
+        return 0;
+    }
+#endif
+
+    if(trigger_adc >= n_adcs) {
 		fprintf(stderr, "Number of ADCS set too low or trigger ADC number is too high!\n");
 		return 0;
 	}
 	
-    time_window_low[trigger_adc]=0;
-    time_window_high[trigger_adc]=0;
+    if(triggerless) {
+        trigger_adc=ENGINE_TRIGGERLESS;
+        if(verbose) fprintf(stderr, "Building events without a trigger from events within %llu ticks of the %s event.\n", build_window, build_extending?"latest":"first");
+    } else if(!rules_filename) { /* The windows are defaults for rules, which may have another trigger */
+        time_window_low[trigger_adc]=0;
+        time_window_high[trigger_adc]=0;
+    }
 
-	if(verbose) {
+    if(verbose) {
 		fprintf(stderr, "OPTIONS:\n\tverbose=%i\n\toutput_mode=%i\n\tskip_lines=%i\n\tn_adcs=%i\n\tcoinc_table_size=%u\n\tmin_multiplicity=%i\n\n", verbose, output_mode, skip_lines, n_adcs, coinc_table_size, min_multiplicity);
 	    fprintf(stderr, "\tADC\tlow\thigh\trequire?\n");
         for(adc=0; adc < n_adcs; adc++) {
 	        fprintf(stderr, "\t%i\t%lli\t%lli\t%s\n", adc, time_window_low[adc], time_window_high[adc], adc==trigger_adc?"Yes, trigger":(require[adc]?"Yes":"No"));
         }
     }
-	skip_lines++;
-	while(skip_lines--) {
-		if(!fgets(buffer, 100, read_file)) {
-			fprintf(stderr, "Can't skip more lines than there are in the input!\n");
-			return 0;
-		}
-	}
-    if(!read_file) {
-        fprintf(stderr, "Error: input file could not be read.\n");
-        return 0;
+    if(n_inputs) { /* All the inputs were given as options, so the only file name argument is the output */
+        if(output_filename) {
+            fprintf(stderr, "With --input, only the output file can be given as an argument.\n");
+            return 0;
+        }
+        output_filename=input_filename;
+        input_filename=NULL;
+    } else if(timestamp_bits) { /* A single input, but its timestamps need unwrapping */
+        inputs[0].filename=input_filename;
+        inputs[0].adc_offset=0;
+        inputs[0].timestamp_offset=0;
+        n_inputs=1;
+    }
+    if(n_inputs) {
+        if(parallel) {
+            fprintf(stderr, "--parallel needs a single input file.\n");
+            return 0;
+        }
+        merge=merge_create(n_adcs, timestamp_bits);
+        if(!merge) {
+            fprintf(stderr, "Could not allocate memory for merging the inputs.\n");
+            return 0;
+        }
+        for(i=0; i < n_inputs; i++) {
+            merge_input=open_input(inputs[i].filename, input_format, skip_lines, n_adcs, 0);
+            if(!merge_input)
+                return 0;
+            if(!merge_add(merge, merge_input, inputs[i].filename?inputs[i].filename:"(standard input)", inputs[i].adc_offset, inputs[i].timestamp_offset)) {
+                fprintf(stderr, "Could not allocate memory for merging the inputs.\n");
+                return 0;
+            }
+            if(verbose) fprintf(stderr, "Merging input %s with ADC offset %i and timestamp offset %lli.\n", inputs[i].filename?inputs[i].filename:"(standard input)", inputs[i].adc_offset, inputs[i].timestamp_offset);
+        }
+    } else {
+        read_file=open_input(input_filename, input_format, skip_lines, n_adcs, follow);
+        if(!read_file)
+            return 0;
+        if((parallel || build_index || checkpoint_filename) && !input_seekable(read_file)) {
+            fprintf(stderr, "--parallel, --index and --checkpoint need a regular file as input.\n");
+            return 0;
+        }
+        data_begin=input_offset(read_file);
     }
 	if(verbose) {
-        fprintf(stderr, "Allocating %i adcs and a coinc table of %i events.\n", n_adcs, coinc_table_size);
+        fprintf(stderr, "Allocating %i adcs and a coinc table of at most %u events.\n", n_adcs, coinc_table_size);
     }
-    coinc_table  = (event *)malloc(coinc_table_size*(sizeof(event)));	
-	coinc_events = (int *)malloc(n_adcs*(sizeof(int)));
-	n_adc_events = (int *)malloc(n_adcs*(sizeof(int)));
-	n_coinc_adc_events = (int *)malloc(n_adcs*(sizeof(int)));
-    timediff_histogram = (unsigned int **)malloc(n_adcs*(sizeof(unsigned int *)));
+    coinc_engine_config_init(&config);
+    config.n_adcs=n_adcs;
+    config.trigger_adc=trigger_adc;
     for(adc=0; adc < n_adcs; adc++) {
-		n_adc_events[adc]= 0; 
-		n_coinc_adc_events[adc]= 0; 
-        timediff_histogram[adc] = (unsigned int *)calloc(time_window_high[adc]-time_window_low[adc]+1, sizeof(unsigned int));
-	}
-
-
-	for(i=0; i < coinc_table_size; i++) {
-        insert_blank_event(&coinc_table[i]);
+        config.time_window_low[adc]=time_window_low[adc];
+        config.time_window_high[adc]=time_window_high[adc];
+        config.require[adc]=require[adc];
     }
-    for(i=coinc_table_size/2; i < coinc_table_size; i++) {
-        if(read_event_from_file(read_file, &coinc_table[i], n_adcs)) {
-			lines_read++;
-			n_adc_events[coinc_table[i].adc]++; 
-		} else {
-			coinc_table_size=i;
-		}
-
+    config.min_multiplicity=min_multiplicity;
+    config.table_size=coinc_table_size;
+    config.histogram_bins=histogram_bins;
+    config.histogram_width=histogram_width;
+    config.histogram_log=histogram_log;
+    config.n_delays=n_delays;
+    for(i=0; i < n_delays; i++) {
+        config.delay[i]=delays[i];
     }
-
-    i=coinc_table_size/2;
-
-	while(coinc_table_size > 1) {
-        if(((!(lines_read%1000)) || endgame) && !silent) {
-            fprintf(stderr,"%10u LINES READ: %10u coincs\r", lines_read, coincs_found);
+    config.build_window=build_window;
+    config.build_extending=build_extending;
+    reader.in=read_file;
+    reader.merge=merge;
+    reader.n_adcs=n_adcs;
+    reader.index=NULL;
+    reader.range=(from_time_given || to_time_given);
+    reader.range_begin=from_time;
+    reader.range_end=to_time_given?to_time:ULLONG_MAX;
+    reader.halo_begin=0;
+    reader.halo_end=ULLONG_MAX;
+    if(reader.range) { /* The partners of the triggers at the edges are read too */
+        coinc_engine_config_reach(&config, &reach_min, &reach_max, &reach);
+        reader.halo_begin=from_time;
+        if(reach_min < 0)
+            reader.halo_begin=(from_time > (unsigned long long int)-reach_min)?from_time-(unsigned long long int)-reach_min:0;
+        if(to_time_given) {
+            reader.halo_end=to_time;
+            if(reach_max > 0)
+                reader.halo_end=(ULLONG_MAX-to_time > (unsigned long long int)reach_max)?to_time+reach_max:ULLONG_MAX;
         }
-        
-        if(coinc_table[i].adc == trigger_adc) {
-			adcs_in_coinc=0;
-            all_required_found=1; /* This will be set to zero later, if false */
-			for(adc=0; adc < n_adcs; adc++) {
-				coinc_events[adc]= -1; 
-			}
-			coinc_events[trigger_adc]=i;
-			for(j=1; j<coinc_table_size; j++) {
-				k=(i+j)%coinc_table_size;
-				time_difference=coinc_table[k].timestamp-coinc_table[i].timestamp;
-				if(time_difference >= time_window_low[coinc_table[k].adc] && time_difference <= time_window_high[coinc_table[k].adc] && coinc_table[k].adc!=trigger_adc  && i != k && coinc_table[k].adc != N_ADCS_MAX-1) { /* Conditions for coincidence met */
-				    coinc_events[coinc_table[k].adc]=k;
-                }
+        if(verbose) fprintf(stderr, "Searching triggers from %llu to %llu, reading events from %llu to %llu.\n", reader.range_begin, reader.range_end, reader.halo_begin, reader.halo_end);
+    }
+    if(reader.halo_begin && input_filename && input_seekable(read_file) && !resume) {
+        index=load_index(input_filename, input_format, read_file, 0);
+        if(index && !seek_index(read_file, index, reader.halo_begin)) {
+            if(verbose) fprintf(stderr, "The index does not match the input anymore.\n");
+            index_free(index);
+            index=load_index(input_filename, input_format, read_file, 1);
+            if(index && !seek_index(read_file, index, reader.halo_begin))
+                fprintf(stderr, "Warning: the input changed while it was indexed, reading it from the beginning.\n");
+        }
+        if(index) {
+            if(verbose) fprintf(stderr, "Starting from offset %llu of the input.\n", input_offset(read_file));
+            index_free(index);
+        }
+    } else if(build_index && !reader.range && !resume) {
+        reader.index=index_create(input_offset(read_file), INDEX_STRIDE_DEFAULT);
+        if(!reader.index) {
+            fprintf(stderr, "Could not allocate memory for the index of the input.\n");
+            return 0;
+        }
+    }
+    if(rules_filename) {
+        if(output_filename) {
+            fprintf(stderr, "With --rules, the output files are given in the rules file.\n");
+            return 0;
+        }
+        rule_defaults.config=config;
+        rule_defaults.mode=output_mode;
+        rule_defaults.triggertime=triggertime;
+        rule_defaults.output_format=output_format;
+        rule_defaults.output_filename=NULL;
+        n_rules=rules_read(rules_filename, &rule_defaults, &rules);
+        if(!n_rules)
+            return 0;
+        rules_ok=search_rules(rules, n_rules, &reader, monitors, n_monitors, flush_interval, output_n_events);
+        rules_free(rules, n_rules);
+        for(i=0; i < n_monitors; i++) {
+            monitor_free(monitors[i]);
+        }
+        input_close(read_file);
+        merge_free(merge);
+        return rules_ok;
+    }
+    timed=(stats_filename && !follow && !parallel && !threads && !output_n_events); /* The stages can be timed */
+    coinc=coinc_create(&config);
+    if(!coinc) {
+        fprintf(stderr, "Could not allocate memory for the coinc table.\n");
+        return 0;
+    }
+    if(!timed) /* search_timed() pulls the coincidences */
+        coinc_set_callback(coinc, emit_coincidence, &emitter);
+    stats=coinc_stats(coinc);
+    if(resume) {
+        checkpoint_file=fopen(checkpoint_filename, "rb");
+        if(checkpoint_file) {
+            fclose(checkpoint_file);
+            if(!checkpoint_read(checkpoint_filename, &checkpoint, coinc))
+                return 0;
+            if(checkpoint.input_size != input_size(read_file) || checkpoint.n_monitors != n_monitors) {
+                fprintf(stderr, "Checkpoint \"%s\" is of another input or other monitors.\n", checkpoint_filename);
+                return 0;
             }
-			for(adc=0; adc < n_adcs; adc++) {
-				if (coinc_events[adc] != -1) { /* There is an event for this ADC */
-					adcs_in_coinc++;
-    			} else { /* There isn't */
-                    if(require[adc]) {
-                        all_required_found=0;
-                    }
-                }
-			}
-			if(adcs_in_coinc >= min_multiplicity && all_required_found) {
-                if(triggertime) {
-                    fprintf(output_file, "%13llu ", coinc_table[coinc_events[trigger_adc]].timestamp);
-                }
-                if(monitor) {
-                    fprintf(output_file, "%7i ", advance_monitorfile_until_timestamp(monitor, coinc_table[coinc_events[trigger_adc]].timestamp));
-                }
-
-				for (adc=0; adc < n_adcs; adc++) {
-                    if(coinc_events[adc] != -1) {
-                        if(adc != trigger_adc) {
-                            time_difference=coinc_table[coinc_events[adc]].timestamp-coinc_table[coinc_events[trigger_adc]].timestamp;
-                            if(time_difference < time_window_low[adc]) {
-                                fprintf(stderr, "Time difference too low! ADC=%i, triggering adc=%i, time diff %lli\n. This should be impossible!\n", adc, trigger_adc, time_difference);
-                            }
-                            if(time_difference > time_window_high[adc]) {
-                                fprintf(stderr, "Time difference too high! ADC=%i, triggering adc=%i, time diff %lli\n. This should be impossible!\n", adc, trigger_adc, time_difference);
-                            }
-                            timediff_histogram[adc][time_difference-time_window_low[adc]]++;
-                        } else {
-                            time_difference=0;
-                        }
-                        n_coinc_adc_events[adc]++;
-						switch (output_mode) {
-							case MODE_RAW:
-								fprintf(output_file, "%5i ", coinc_table[coinc_events[adc]].channel);
-								break;
-                            case MODE_TIMESTAMPS:
-                                fprintf(output_file, "%13llu ", coinc_table[coinc_events[adc]].timestamp);
-                                break;
-                            case MODE_TIMEDIFF_AND_CHANNEL:
-                                fprintf(output_file, "%5i %7lli ", coinc_table[coinc_events[adc]].channel, time_difference);
-							    break;
-                            case MODE_TIME_AND_CHANNEL:
-                                fprintf(output_file, "%5i %13llu ",coinc_table[coinc_events[adc]].channel, coinc_table[coinc_events[adc]].timestamp);
-                                break;
-                            default:
-								break;
-						}
-
-					} else {
-                        switch (output_mode) {
-                            case MODE_TIME_AND_CHANNEL:
-                                fprintf(output_file, "    0             0 ");
-                                break;
-                            case MODE_TIMEDIFF_AND_CHANNEL:
-                                fprintf(output_file, "    0       0 ");
-                                break;
-                            case MODE_TIMESTAMPS:
-                                fprintf(output_file, "             0 ");
-                                break;
-                            default:
-						        fprintf(output_file, "     0 ");
-                                break;
-                            }
-					}
+            input_seek(read_file, checkpoint.input_offset);
+            if(!silent) fprintf(stderr, "Resuming from input offset %llu with %llu coincidences found.\n", checkpoint.input_offset, stats->n_coincidences);
+        } else {
+            if(!silent) fprintf(stderr, "No checkpoint \"%s\" yet, starting from the beginning.\n", checkpoint_filename);
+            resume=0;
+        }
+    }
 
-				}
-                fprintf(output_file, "\n");
-				fflush(stdout);
-				coincs_found++;
-                if(coincs_found == output_n_events)
-                    break;
-			}
+    writer.mode=output_mode;
+    writer.triggertime=triggertime;
+    set_writer_monitors(&writer, monitors, n_monitors);
+    writer.flush_interval=flush_interval;
+    writer.spectra=NULL;
+    if(n_spectra) {
+        spectra=spectra_create(spectrum_definitions, n_spectra, spectrum_channels, matrix_bins, coinc_config(coinc));
+        if(!spectra) {
+            fprintf(stderr, "Could not allocate memory for the spectra.\n");
+            return 0;
         }
-        
-        if(endgame) {
-            if(endgame==(int)coinc_table_size) {break;}
-            endgame++;
-            insert_blank_event(&coinc_table[(i+coinc_table_size/2)%coinc_table_size]);
-        } else {
-            if(read_event_from_file(read_file, &coinc_table[(i+coinc_table_size/2)%coinc_table_size], n_adcs)) {
-                lines_read++;
-                n_adc_events[coinc_table[(i+coinc_table_size/2)%coinc_table_size].adc]++;
-            } else {     
-                endgame=1;
-				if(verbose) fprintf(stderr, "\nEntering endgame (not reading input anymore)\n");
-			}
+        writer.spectra=spectra;
+    }
+    output_file=open_writer(&writer, output_filename, output_format, &config, resume?checkpoint.output.size:-1);
+    if(!output_file)
+        return 0;
+    if(delayed_filename) {
+        if(strcmp(delayed_filename, "-") == 0 && output_file == stdout) {
+            fprintf(stderr, "The output and the delayed output can't both go to standard output.\n");
+            return 0;
+        }
+        delayed_writer.writer.mode=output_mode;
+        delayed_writer.writer.triggertime=triggertime;
+        set_writer_monitors(&delayed_writer.writer, monitors, n_monitors);
+        delayed_writer.writer.flush_interval=flush_interval;
+        delayed_writer.writer.spectra=NULL;
+        delayed_writer.config=coinc_config(coinc);
+        delayed_file=open_writer(&delayed_writer.writer, delayed_filename, OUTPUT_FORMAT_TEXT, &config, resume?checkpoint.delayed_output.size:-1);
+        if(!delayed_file)
+            return 0;
+        coinc_set_delayed_callback(coinc, write_delayed_coincidence, &delayed_writer);
+    }
+    emitter.writer=&writer;
+    emitter.pipeline=NULL;
+    emitter.n_emitted=0;
+    emitter.n_max=output_n_events;
+    if(resume) {
+        restore_output_position(&writer, &checkpoint.output);
+        if(delayed_file)
+            restore_output_position(&delayed_writer.writer, &checkpoint.delayed_output);
+        emitter.n_emitted=checkpoint.n_emitted;
+    }
+    if(threads) {
+        emitter.pipeline=pipeline_start(n_adcs, read_event, &reader, write_coincidence, &writer);
+        if(!emitter.pipeline) {
+            fprintf(stderr, "Could not start threads.\n");
+            return 0;
+        }
+        if(verbose) fprintf(stderr, "Reading, searching and writing in separate threads.\n");
+    }
+
+    if(parallel) {
+        chunk_output.writer=&writer;
+        chunk_output.monitors=monitors;
+        chunk_output.n_monitors=n_monitors;
+        chunk_output.stats=stats;
+        chunk_output.spectra=spectra;
+        writer.spectra=NULL; /* The chunks have their own */
+        chunk_sink.open=open_chunk_sink;
+        chunk_sink.write=write_coincidence;
+        chunk_sink.merge=merge_chunk_sink;
+        chunk_sink.discard=discard_chunk_sink;
+        chunk_sink.context=&chunk_output;
+        if(verbose) fprintf(stderr, "Searching chunks of the input in %u threads.\n", parallel);
+        parallel_result=parallel_run(input_filename, input_format, data_begin, &config, parallel, parallel_chunk_size, &chunk_sink, coinc_engine(coinc));
+        if(parallel_result == PARALLEL_FAILED) {
+            fprintf(stderr, "\nCould not process the input in parallel (out of memory or could not start threads).\n");
+            output_close(writer.out);
+            columnar_writer_close(writer.columnar);
+            return 0;
+        }
+        if(parallel_result == PARALLEL_WRITE_FAILED) {
+            fprintf(stderr, "\nError writing output.\n");
+            return 0;
         }
+    }
 
-        i++;
-        if(i==coinc_table_size) {
-            i=0;
+    snapshots.interval=snapshot_interval;
+    snapshots.next=time(NULL)+snapshot_interval;
+    snapshots.stats_filename=stats_filename;
+    snapshots.timer=&stats_timer;
+    checkpoints.filename=checkpoint_filename;
+    checkpoints.interval=checkpoint_interval;
+    checkpoints.next=time(NULL)+checkpoint_interval;
+    checkpoints.reader=&reader;
+    checkpoints.emitter=&emitter;
+    checkpoints.writer=&writer;
+    checkpoints.delayed=delayed_file?&delayed_writer.writer:NULL;
+    checkpoints.output_file=output_file;
+    checkpoints.delayed_file=delayed_file;
+    if(follow) {
+        writer.follow=1;
+        coinc_engine_config_reach(coinc_config(coinc), &reach_min, &reach_max, &reach);
+        flush_delay=(reach_max > 0?(unsigned long long int)reach_max:0)+latency;
+        if(verbose) fprintf(stderr, "Following the input, coincidences are written out at most %llu ticks after their trigger.\n", flush_delay);
+        follow_input(coinc, &reader, &writer, delayed_file?&delayed_writer.writer:NULL, flush_delay, &snapshots);
+    } else if(timed) {
+        if(!search_timed(coinc, &reader, &emitter, &stats_timer, &snapshots, &checkpoints)) {
+            fprintf(stderr, "\nCould not allocate memory for the coinc table.\n");
+            return 0;
+        }
+    }
+	while(!parallel && !follow && !timed && (emitter.pipeline?pipeline_read_event(emitter.pipeline, &new_event):read_event(&reader, &new_event))) {
+        if(!push_events(coinc, &reader, &new_event, 1))
+            break;
+        if(!(++n_read%1000)) {
+            if(!silent)
+                fprintf(stderr,"%10llu LINES READ: %10llu coincs\r", stats->n_events, stats->n_coincidences);
+            take_snapshot(&snapshots, coinc);
+            take_checkpoint(&checkpoints, coinc);
+        }
+    }
+    if(verbose) fprintf(stderr, "\nEntering endgame (not reading input anymore)\n");
+    coinc_finish(coinc);
+    write_ok=emitter.pipeline?pipeline_stop(emitter.pipeline):1;
+    if(coinc_failed(coinc)) {
+        fprintf(stderr, "\nCould not allocate memory for the coinc table.\n");
+        output_close(writer.out);
+        columnar_writer_close(writer.columnar);
+        return 0;
+    }
+    if(delayed_file) {
+        write_ok=close_writer(&delayed_writer.writer, delayed_file) && write_ok;
+    }
+    if(!close_writer(&writer, output_file) || !write_ok) {
+        fprintf(stderr, "\nError writing output.\n");
+        input_close(read_file);
+        merge_free(merge);
+        return 0;
+    }
+    if(spectra && !spectra_write(spectra))
+        return 0;
+    spectra_free(spectra);
+    if(reader.index) {
+        if(input_offset(read_file) == input_size(read_file) && !input_error(read_file)) {
+            index_file=index_filename(input_filename);
+            if(!index_file || !index_write(reader.index, index_file, input_size(read_file)))
+                fprintf(stderr, "Warning: could not write the index of the input.\n");
+            else if(verbose) fprintf(stderr, "Wrote the index of the input to %s.\n", index_file);
+            free(index_file);
         }
+        index_free(reader.index);
+    }
+    if(checkpoint_filename)
+        remove(checkpoint_filename);
+    if(stats_filename && !stats_write(stats_filename, stats, coinc_config(coinc), &stats_timer, 1)) {
+        fprintf(stderr, "Could not write statistics to \"%s\".\n", stats_filename);
+        return 0;
     }
     if(!silent) {
-    	fprintf(stderr,"%10u LINES READ: %10u coincs\nDone.\n", lines_read, coincs_found);
-/*        if(monitor) {
-            fprintf(stderr, "Total %i monitor counts in monitor file.", advance_monitorfile_until_timestamp(monitor, ULONG_MAX)+1);
-        } */
-        fprintf(stderr, "--------------------------------------------------------------------\n");
-        fprintf(stderr, "ADC     Total  In coinc   %% of   %% of     1%%      5%%     95%%     99%%\n");
-        fprintf(stderr, "                         these coincs  limit   limit   limit   limit\n");
-        fprintf(stderr, "--------------------------------------------------------------------\n");
-
-	    for(adc=0; adc < n_adcs; adc++) {
-            if(n_adc_events[adc]) {
-    		    fprintf(stderr, "%3i %9i %9i %5.1f%% %5.1f%%", adc, n_adc_events[adc], n_coinc_adc_events[adc], n_coinc_adc_events[adc]/(0.01*n_adc_events[adc]), n_coinc_adc_events[adc]/(0.01*n_coinc_adc_events[trigger_adc]));
-                fprintf(stderr, "%7i %7i %7i %7i\n", 
-                    find_percentile(0.01, timediff_histogram[adc], time_window_low[adc], time_window_high[adc]),
-                    find_percentile(0.05, timediff_histogram[adc], time_window_low[adc], time_window_high[adc]),
-                    find_percentile(0.95, timediff_histogram[adc], time_window_low[adc], time_window_high[adc]), 
-                    find_percentile(0.99, timediff_histogram[adc], time_window_low[adc], time_window_high[adc])
-                );
-            }
-	    }
-        fprintf(stderr, "--------------------------------------------------------------------\n");
+    	fprintf(stderr,"%10llu LINES READ: %10llu coincs\nDone.\n", stats->n_events, stats->n_coincidences);
+        print_summary(stats, coinc_config(coinc));
+    }
+    coinc_free(coinc);
+    for(i=0; i < n_monitors; i++) {
+        monitor_free(monitors[i]);
     }
+    input_close(read_file);
+    merge_free(merge);
     return 1;
-}
\ No newline at end of file
+}
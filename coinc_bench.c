@@ -0,0 +1,301 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+/* Throughput benchmark of coinc over standard scenarios of synthetic data. Every scenario is run through the stages of
+ * coinc one at a time: generating the events, writing and reading them as text and binary, the coincidence search
+ * alone and the search with text output. Each stage reports its speed and peak memory use, so that builds can be
+ * compared on the same computer. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <coinc_config.h>
+#include "coinc_lib.h"
+#include "coinc_kernel.h"
+#include "coinc_input.h"
+#include "coinc_output.h"
+#include "coinc_binary.h"
+#include "coinc_generator.h"
+
+#define BENCH_N_EVENTS_DEFAULT 2000000
+#define BENCH_TICK_PS 1000 /* Scenario rates are per second of 1 ns ticks */
+#define BENCH_TEXT_FILE "coinc-bench.txt"
+#define BENCH_BINARY_FILE "coinc-bench.bin"
+#define BENCH_FILENAME_MAX 4096
+#define HELP_TEXT "Usage: %s [OPTION]\n\nRuns the standard benchmark scenarios.\nValid options:\n\t--nevents=NUM\tevents per scenario (default 2000000)\n\t--scenario=NUM\trun only scenario NUM\n\t--tmpdir=DIR\twrite the temporary input files in DIR (default: current directory)\n\n"
+
+struct scenario {
+    const char *name;
+    unsigned int n_adcs;
+    double rate; /* Random events per second in each ADC */
+    long long int window; /* The windows of the other ADCs are -window..window ticks */
+    unsigned int table_size;
+};
+
+static const struct scenario scenarios[]={
+    {"2 ADCs, low rate, small window", 2, 1e3, 100, ENGINE_TABLE_SIZE_DEFAULT},
+    {"2 ADCs, high rate, small window", 2, 1e6, 100, ENGINE_TABLE_SIZE_DEFAULT},
+    {"64 ADCs, low rate, small window", 64, 1e3, 100, ENGINE_TABLE_SIZE_DEFAULT},
+    {"64 ADCs, high rate, small window", 64, 1e5, 100, ENGINE_TABLE_SIZE_DEFAULT},
+    {"8 ADCs, high rate, large window", 8, 1e5, 100000, ENGINE_TABLE_SIZE_DEFAULT},
+    {"8 ADCs, high rate, large window, small table", 8, 1e5, 100000, 1024},
+    {NULL, 0, 0.0, 0, 0}
+};
+
+struct stage {
+    double t0;
+    unsigned long long int n_coincidences;
+};
+
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/* Peak resident memory is only known on Linux, where it can also be reset between stages */
+static void peak_rss_reset(void) {
+    FILE *f=fopen("/proc/self/clear_refs", "w");
+    if(!f)
+        return;
+    fputs("5", f);
+    fclose(f);
+}
+
+static double peak_rss_mb(void) {
+    FILE *f=fopen("/proc/self/status", "r");
+    char line[256];
+    unsigned long long int kb;
+    double mb=-1.0;
+    if(!f)
+        return mb;
+    while(fgets(line, sizeof(line), f)) {
+        if(sscanf(line, "VmHWM: %llu kB", &kb) == 1)
+            mb=kb/1024.0;
+    }
+    fclose(f);
+    return mb;
+}
+
+static void stage_start(struct stage *stage) {
+    peak_rss_reset();
+    stage->n_coincidences=0;
+    stage->t0=now();
+}
+
+static void stage_report(const struct stage *stage, const char *name, unsigned long long int n_events, int ok) {
+    double t=now()-stage->t0, rss=peak_rss_mb();
+    if(!ok) {
+        printf("  %-16s failed\n", name);
+        return;
+    }
+    printf("  %-16s %9.3f %11.3f", name, t, n_events/t/1e6);
+    if(stage->n_coincidences) {
+        printf(" %11.3f", stage->n_coincidences/t/1e3);
+    } else {
+        printf(" %11s", "-");
+    }
+    if(rss >= 0.0) {
+        printf(" %11.1f\n", rss);
+    } else {
+        printf(" %11s\n", "-");
+    }
+}
+
+static int count_coincidence(void *context, coincidence_t *c) {
+    struct stage *stage=context;
+    (void)c;
+    stage->n_coincidences++;
+    return 1;
+}
+
+struct bench_output {
+    struct stage *stage;
+    output_t *out;
+};
+
+static int write_coincidence(void *context, coincidence_t *c) {
+    struct bench_output *output=context;
+    output->stage->n_coincidences++;
+    output_coincidence(output->out, MODE_RAW, 0, 0, c);
+    return 1;
+}
+
+static int write_text(const char *filename, const event *events, unsigned long long int n_events) {
+    FILE *f=fopen(filename, "w");
+    output_t *out;
+    unsigned long long int i;
+    if(!f)
+        return 0;
+    out=output_open(f);
+    if(!out) {
+        fclose(f);
+        return 0;
+    }
+    output_string(out, "adc channel timestamp\n");
+    for(i=0; i < n_events; i++) {
+        output_int(out, events[i].adc, 0);
+        output_char(out, ' ');
+        output_int(out, events[i].channel, 0);
+        output_char(out, ' ');
+        output_uint(out, events[i].timestamp, 0);
+        output_char(out, '\n');
+    }
+    return output_close(out) && fclose(f) == 0;
+}
+
+static int write_binary(const char *filename, const event *events, unsigned long long int n_events, unsigned int n_adcs) {
+    FILE *f=fopen(filename, "wb");
+    binary_header_t header;
+    unsigned char record[BINARY_RECORD_SIZE];
+    unsigned long long int i;
+    int ok;
+    if(!f)
+        return 0;
+    binary_header_init(&header);
+    header.n_adcs=n_adcs;
+    header.tick_ps=BENCH_TICK_PS;
+    header.n_events=n_events;
+    ok=binary_header_write(&header, f);
+    for(i=0; ok && i < n_events; i++) {
+        binary_record_encode(record, &events[i]);
+        ok=(fwrite(record, BINARY_RECORD_SIZE, 1, f) == 1);
+    }
+    return (fclose(f) == 0) && ok;
+}
+
+static int read_input(const char *filename, input_format format, unsigned long long int n_events) {
+    input_t *in=input_open(filename, format);
+    unsigned long long int n=0;
+    event event;
+    if(!in)
+        return 0;
+    if(format == INPUT_FORMAT_TEXT)
+        input_skip(in, 1);
+    while(input_read_event(in, &event)) {
+        n++;
+    }
+    input_close(in);
+    return n == n_events;
+}
+
+static int search(const engine_config_t *config, const event *events, unsigned long long int n_events, engine_emit_function emit, void *context) {
+    coinc_t *coinc=coinc_create(config);
+    int ok;
+    if(!coinc)
+        return 0;
+    coinc_set_callback(coinc, emit, context);
+    ok=(coinc_push(coinc, events, n_events) == n_events) && coinc_finish(coinc);
+    coinc_free(coinc);
+    return ok;
+}
+
+static int run_scenario(const struct scenario *scenario, unsigned long long int n_events, const char *text_filename, const char *binary_filename) {
+    generator_config_t generator_config;
+    generator_t *g;
+    engine_config_t config;
+    event *events=malloc(n_events*sizeof(event));
+    struct stage stage;
+    struct bench_output output;
+    FILE *out;
+    unsigned long long int i;
+    unsigned int adc;
+    int ok;
+    if(!events)
+        return 0;
+    generator_config_init(&generator_config);
+    generator_config.n_adcs=scenario->n_adcs;
+    generator_config.true_fraction=0.5;
+    generator_config.jitter=scenario->window/10.0;
+    for(adc=0; adc < scenario->n_adcs; adc++) {
+        generator_config.rate[adc]=scenario->rate*BENCH_TICK_PS*1e-12;
+    }
+    coinc_engine_config_init(&config);
+    config.n_adcs=scenario->n_adcs;
+    config.table_size=scenario->table_size;
+    for(adc=1; adc < scenario->n_adcs; adc++) {
+        config.time_window_low[adc]=-scenario->window;
+        config.time_window_high[adc]=scenario->window;
+    }
+    printf("%s: %llu events, %.0f events/s per ADC, window %+lli..%+lli, table %u\n", scenario->name, n_events, scenario->rate, -scenario->window, scenario->window, scenario->table_size);
+    printf("  %-16s %9s %11s %11s %11s\n", "stage", "seconds", "Mevents/s", "kcoincs/s", "peak RSS/MB");
+
+    stage_start(&stage);
+    g=generator_create(&generator_config);
+    ok=(g != NULL);
+    for(i=0; ok && i < n_events; i++) {
+        ok=generator_next(g, &events[i]);
+    }
+    generator_free(g);
+    stage_report(&stage, "generate", n_events, ok);
+
+    stage_start(&stage);
+    stage_report(&stage, "write text", n_events, write_text(text_filename, events, n_events));
+    stage_start(&stage);
+    stage_report(&stage, "read text", n_events, read_input(text_filename, INPUT_FORMAT_TEXT, n_events));
+    stage_start(&stage);
+    stage_report(&stage, "write binary", n_events, write_binary(binary_filename, events, n_events, scenario->n_adcs));
+    stage_start(&stage);
+    stage_report(&stage, "read binary", n_events, read_input(binary_filename, INPUT_FORMAT_BINARY, n_events));
+    remove(text_filename);
+    remove(binary_filename);
+
+    stage_start(&stage);
+    ok=search(&config, events, n_events, count_coincidence, &stage);
+    stage_report(&stage, "search", n_events, ok);
+
+    out=tmpfile();
+    output.stage=&stage;
+    output.out=out?output_open(out):NULL;
+    stage_start(&stage);
+    ok=output.out && search(&config, events, n_events, write_coincidence, &output);
+    ok=output_close(output.out) && ok;
+    stage_report(&stage, "search + output", n_events, ok);
+    if(out)
+        fclose(out);
+    free(events);
+    printf("\n");
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    unsigned long long int n_events=BENCH_N_EVENTS_DEFAULT;
+    int only=-1, i;
+    const char *tmpdir=".";
+    char text_filename[BENCH_FILENAME_MAX], binary_filename[BENCH_FILENAME_MAX];
+    const window_kernel_t *kernel=coinc_kernel_select(NULL);
+    for(i=1; i < argc; i++) {
+        if(sscanf(argv[i], "--nevents=%llu", &n_events) == 1 && n_events > 0)
+            continue;
+        if(sscanf(argv[i], "--scenario=%i", &only) == 1)
+            continue;
+        if(strncmp(argv[i], "--tmpdir=", 9) == 0) {
+            tmpdir=argv[i]+9;
+            continue;
+        }
+        fprintf(stderr, HELP_TEXT, argv[0]);
+        return 0;
+    }
+    snprintf(text_filename, sizeof(text_filename), "%s/%s", tmpdir, BENCH_TEXT_FILE);
+    snprintf(binary_filename, sizeof(binary_filename), "%s/%s", tmpdir, BENCH_BINARY_FILE);
+    printf("coinc %s benchmark, %s window search kernel\n\n", coinc_VERSION, kernel->name);
+    for(i=0; scenarios[i].name; i++) {
+        if(only >= 0 && i != only)
+            continue;
+        printf("%i. ", i);
+        if(!run_scenario(&scenarios[i], n_events, text_filename, binary_filename)) {
+            fprintf(stderr, "Could not allocate memory for scenario %i.\n", i);
+            return 0;
+        }
+    }
+    return 1;
+}
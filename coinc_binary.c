@@ -0,0 +1,59 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <string.h>
+#include "coinc_binary.h"
+
+void binary_header_init(binary_header_t *header) {
+    header->version=BINARY_VERSION;
+    header->header_size=BINARY_HEADER_SIZE;
+    header->record_size=BINARY_RECORD_SIZE;
+    header->n_adcs=0;
+    header->tick_ps=0;
+    header->n_events=0;
+}
+
+int binary_is_binary(const unsigned char *buf, size_t size) {
+    return (size >= BINARY_MAGIC_SIZE && memcmp(buf, BINARY_MAGIC, BINARY_MAGIC_SIZE) == 0);
+}
+
+binary_header_result binary_header_decode(binary_header_t *header, const unsigned char *buf, size_t size) {
+    if(size < BINARY_HEADER_SIZE || !binary_is_binary(buf, size))
+        return BINARY_HEADER_NOT_BINARY;
+    header->version=binary_get_u32(buf+8);
+    header->header_size=binary_get_u32(buf+12);
+    header->record_size=binary_get_u32(buf+16);
+    header->n_adcs=binary_get_u32(buf+20);
+    header->tick_ps=binary_get_u64(buf+24);
+    header->n_events=binary_get_u64(buf+32);
+    if(header->version != BINARY_VERSION)
+        return BINARY_HEADER_UNSUPPORTED;
+    if(header->header_size < BINARY_HEADER_SIZE || header->record_size < BINARY_RECORD_SIZE)
+        return BINARY_HEADER_CORRUPTED;
+    return BINARY_HEADER_OK;
+}
+
+void binary_header_encode(const binary_header_t *header, unsigned char *buf) {
+    memset(buf, 0, BINARY_HEADER_SIZE);
+    memcpy(buf, BINARY_MAGIC, BINARY_MAGIC_SIZE);
+    binary_put_u32(buf+8, header->version);
+    binary_put_u32(buf+12, header->header_size);
+    binary_put_u32(buf+16, header->record_size);
+    binary_put_u32(buf+20, header->n_adcs);
+    binary_put_u64(buf+24, header->tick_ps);
+    binary_put_u64(buf+32, header->n_events);
+}
+
+int binary_header_write(const binary_header_t *header, FILE *f) {
+    unsigned char buf[BINARY_HEADER_SIZE];
+    binary_header_encode(header, buf);
+    return (fwrite(buf, 1, BINARY_HEADER_SIZE, f) == BINARY_HEADER_SIZE);
+}
@@ -0,0 +1,110 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_BINARY_H
+#define COINC_BINARY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "coinc_event.h"
+
+/* Binary list-mode format, version 1. All integers are little-endian.
+ *
+ * Header (BINARY_HEADER_SIZE bytes):
+ *   offset  size  field
+ *        0     8  magic "COINCBIN"
+ *        8     4  format version (BINARY_VERSION)
+ *       12     4  header size in bytes, records start at this offset
+ *       16     4  record size in bytes
+ *       20     4  number of ADCs, 0 if unknown
+ *       24     8  length of one timestamp tick in picoseconds, 0 if unknown
+ *       32     8  number of events, 0 if unknown (e.g. written to a pipe)
+ *       40    24  reserved, must be zero
+ *
+ * Record (BINARY_RECORD_SIZE bytes), events in the same order as in the text format:
+ *   offset  size  field
+ *        0     8  timestamp (unsigned)
+ *        8     4  channel (signed)
+ *       12     2  ADC (unsigned)
+ *       14     2  reserved, must be zero
+ *
+ * Readers must accept larger header and record sizes and ignore the extra bytes, so that fields can be added without
+ * breaking old readers. Any incompatible change increments the version. */
+
+#define BINARY_MAGIC "COINCBIN"
+#define BINARY_MAGIC_SIZE 8
+#define BINARY_VERSION 1
+#define BINARY_HEADER_SIZE 64
+#define BINARY_RECORD_SIZE 16
+
+struct binary_header {
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t n_adcs;
+    uint64_t tick_ps;
+    uint64_t n_events;
+};
+
+typedef struct binary_header binary_header_t;
+
+typedef enum BINARY_HEADER_RESULT_E {
+    BINARY_HEADER_OK = 0,
+    BINARY_HEADER_NOT_BINARY = 1, /* No magic, or shorter than BINARY_HEADER_SIZE */
+    BINARY_HEADER_UNSUPPORTED = 2, /* Another format version, which is in version */
+    BINARY_HEADER_CORRUPTED = 3 /* Header or record size too small */
+} binary_header_result;
+
+void binary_header_init(binary_header_t *header);
+binary_header_result binary_header_decode(binary_header_t *header, const unsigned char *buf, size_t size); /* Prints nothing, the caller reports errors */
+void binary_header_encode(const binary_header_t *header, unsigned char *buf); /* buf must have room for BINARY_HEADER_SIZE bytes */
+int binary_header_write(const binary_header_t *header, FILE *f);
+int binary_is_binary(const unsigned char *buf, size_t size); /* Non-zero if buf starts with the magic */
+
+static inline uint64_t binary_get_u64(const unsigned char *p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static inline uint32_t binary_get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void binary_put_u64(unsigned char *p, uint64_t v) {
+    int i;
+    for(i=0; i < 8; i++) {
+        p[i]=(unsigned char)(v >> (8*i));
+    }
+}
+
+static inline void binary_put_u32(unsigned char *p, uint32_t v) {
+    int i;
+    for(i=0; i < 4; i++) {
+        p[i]=(unsigned char)(v >> (8*i));
+    }
+}
+
+static inline void binary_record_decode(const unsigned char *p, event *event) {
+    event->timestamp=binary_get_u64(p);
+    event->channel=(int32_t)binary_get_u32(p+8);
+    event->adc=(int)((uint32_t)p[12] | (uint32_t)p[13] << 8);
+}
+
+static inline void binary_record_encode(unsigned char *p, const event *event) {
+    binary_put_u64(p, event->timestamp);
+    binary_put_u32(p+8, (uint32_t)event->channel);
+    p[12]=(unsigned char)event->adc;
+    p[13]=(unsigned char)(event->adc >> 8);
+    p[14]=0;
+    p[15]=0;
+}
+
+#endif /* COINC_BINARY_H */
@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include "coinc_buffer.h"
+#include "coinc_kernel.h"
+
+static int adc_buffer_resize(adc_buffer_t *buffer, unsigned int capacity) {
+    unsigned long long int pos;
+    unsigned int slot;
+    unsigned long long int *timestamp=malloc(capacity*sizeof(unsigned long long int));
+    unsigned long long int *index=malloc(capacity*sizeof(unsigned long long int));
+    int *channel=malloc(capacity*sizeof(int));
+    if(!timestamp || !index || !channel) {
+        free(timestamp);
+        free(index);
+        free(channel);
+        return 0;
+    }
+    for(pos=buffer->head; pos < buffer->tail; pos++) {
+        slot=ADC_BUFFER_SLOT(buffer, pos);
+        timestamp[pos & (capacity-1)]=buffer->timestamp[slot];
+        index[pos & (capacity-1)]=buffer->index[slot];
+        channel[pos & (capacity-1)]=buffer->channel[slot];
+    }
+    coinc_adc_buffer_free(buffer);
+    buffer->timestamp=timestamp;
+    buffer->index=index;
+    buffer->channel=channel;
+    buffer->capacity=capacity;
+    return 1;
+}
+
+int coinc_adc_buffer_init(adc_buffer_t *buffer) {
+    buffer->timestamp=NULL;
+    buffer->index=NULL;
+    buffer->channel=NULL;
+    buffer->head=0;
+    buffer->tail=0;
+    buffer->capacity=0;
+    return adc_buffer_resize(buffer, ADC_BUFFER_SIZE_INITIAL);
+}
+
+void coinc_adc_buffer_free(adc_buffer_t *buffer) {
+    free(buffer->timestamp);
+    free(buffer->index);
+    free(buffer->channel);
+    buffer->timestamp=NULL;
+    buffer->index=NULL;
+    buffer->channel=NULL;
+}
+
+int coinc_adc_buffer_push(adc_buffer_t *buffer, unsigned long long int timestamp, int channel, unsigned long long int index) {
+    unsigned int slot;
+    if(ADC_BUFFER_SIZE(buffer) == buffer->capacity && !adc_buffer_resize(buffer, buffer->capacity*2)) {
+        return 0;
+    }
+    slot=ADC_BUFFER_SLOT(buffer, buffer->tail);
+    buffer->timestamp[slot]=timestamp;
+    buffer->channel[slot]=channel;
+    buffer->index[slot]=index;
+    buffer->tail++;
+    return 1;
+}
+
+static void adc_buffer_shrink(adc_buffer_t *buffer) {
+    if(buffer->capacity > ADC_BUFFER_SIZE_INITIAL && ADC_BUFFER_SIZE(buffer) < buffer->capacity/4) {
+        adc_buffer_resize(buffer, buffer->capacity/2); /* If this fails the old storage is still good */
+    }
+}
+
+void coinc_adc_buffer_drop(adc_buffer_t *buffer) {
+    buffer->head++;
+    adc_buffer_shrink(buffer);
+}
+
+unsigned int coinc_adc_buffer_drop_older(adc_buffer_t *buffer, unsigned long long int timestamp, long long int low) {
+    unsigned long long int head=buffer->head;
+    while(buffer->head < buffer->tail && (long long int)(buffer->timestamp[ADC_BUFFER_SLOT(buffer, buffer->head)]-timestamp) < low) {
+        buffer->head++;
+    }
+    if(buffer->head != head)
+        adc_buffer_shrink(buffer);
+    return (unsigned int)(buffer->head-head);
+}
+
+void coinc_adc_buffer_clear(adc_buffer_t *buffer) {
+    buffer->head=buffer->tail;
+    adc_buffer_shrink(buffer);
+}
+
+static unsigned int highest_bit(uint64_t mask) {
+#ifdef __GNUC__
+    return 63-__builtin_clzll(mask);
+#else
+    unsigned int bit=0;
+    while(mask >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+/* Returns the first position from pos onwards with a time difference to timestamp above limit. The search gallops
+ * forward before bisecting, since the position is usually close to pos. */
+static unsigned long long int adc_buffer_search(const adc_buffer_t *buffer, unsigned long long int pos, unsigned long long int timestamp, long long int limit) {
+    unsigned long long int step=1, low=pos, high, mid;
+    while(1) { /* Invariant: everything before low is at or below the limit */
+        high=low+step;
+        if(high >= buffer->tail) {
+            high=buffer->tail;
+            break;
+        }
+        if((long long int)(buffer->timestamp[ADC_BUFFER_SLOT(buffer, high-1)]-timestamp) > limit)
+            break;
+        low=high;
+        step*=2;
+    }
+    while(low < high) {
+        mid=low+(high-low)/2;
+        if((long long int)(buffer->timestamp[ADC_BUFFER_SLOT(buffer, mid)]-timestamp) > limit) {
+            high=mid;
+        } else {
+            low=mid+1;
+        }
+    }
+    return low;
+}
+
+/* The buffer is gone through from the oldest event in blocks that don't wrap around the end of the ring, testing
+ * each block with the window kernel. Older events have usually been dropped already, so the window starts near the
+ * head, and the search ends at the first block that reaches past the window. If the window turns out to extend
+ * beyond a whole block, its end is found by a galloping search instead, since everything up to it is in the window. */
+int coinc_adc_buffer_find_partner(const adc_buffer_t *buffer, unsigned long long int timestamp, unsigned long long int index, long long int low, long long int high) {
+    unsigned long long int pos, end, first, last;
+    unsigned int slot, n, bit;
+    int partner=-1, partner_before=-1;
+    uint64_t mask;
+    for(pos=buffer->head; pos < buffer->tail; pos+=n) {
+        slot=ADC_BUFFER_SLOT(buffer, pos);
+        n=buffer->capacity-slot;
+        if(n > KERNEL_BLOCK_SIZE)
+            n=KERNEL_BLOCK_SIZE;
+        if(n > buffer->tail-pos)
+            n=(unsigned int)(buffer->tail-pos);
+        mask=coinc_window_mask(buffer->timestamp+slot, n, timestamp, low, high);
+        if(mask) {
+            partner=(int)(slot+highest_bit(mask));
+            while(mask) { /* Events before the trigger come first */
+                bit=highest_bit(mask);
+                if(buffer->index[slot+bit] < index) {
+                    partner_before=(int)(slot+bit);
+                    break;
+                }
+                mask^=(uint64_t)1 << bit;
+            }
+        }
+        if((long long int)(buffer->timestamp[slot+n-1]-timestamp) > high)
+            break;
+        if(partner == (int)(slot+n-1) && pos+n < buffer->tail) { /* The window continues past this block */
+            end=adc_buffer_search(buffer, pos+n, timestamp, high);
+            if(end == pos+n)
+                break;
+            partner=(int)ADC_BUFFER_SLOT(buffer, end-1);
+            first=pos+n; /* Bisect for the last event before the trigger */
+            last=end;
+            while(first < last) {
+                if(buffer->index[ADC_BUFFER_SLOT(buffer, first+(last-first)/2)] < index) {
+                    first=first+(last-first)/2+1;
+                } else {
+                    last=first+(last-first)/2;
+                }
+            }
+            if(first > pos+n)
+                partner_before=(int)ADC_BUFFER_SLOT(buffer, first-1);
+            break;
+        }
+    }
+    return (partner_before >= 0?partner_before:partner);
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_BUFFER_H
+#define COINC_BUFFER_H
+
+#define ADC_BUFFER_SIZE_INITIAL 64 /* Power of two */
+
+/* Events of one ADC in the order they were read, stored as separate arrays of timestamps, channels and positions in
+ * the input. Events are addressed by their position in the buffer, counting all events ever pushed, and the buffer
+ * holds positions head to tail-1. Storage is a ring buffer with a power of two capacity, which grows and shrinks as
+ * needed. */
+struct adc_buffer {
+    unsigned long long int *timestamp;
+    int *channel;
+    unsigned long long int *index; /* Position of the event in the input */
+    unsigned long long int head;
+    unsigned long long int tail;
+    unsigned int capacity;
+};
+
+typedef struct adc_buffer adc_buffer_t;
+
+#define ADC_BUFFER_SLOT(buffer, pos) ((unsigned int)((pos) & ((buffer)->capacity-1)))
+#define ADC_BUFFER_SIZE(buffer) ((unsigned int)((buffer)->tail-(buffer)->head))
+
+int coinc_adc_buffer_init(adc_buffer_t *buffer); /* Returns 0 if memory could not be allocated */
+void coinc_adc_buffer_free(adc_buffer_t *buffer);
+int coinc_adc_buffer_push(adc_buffer_t *buffer, unsigned long long int timestamp, int channel, unsigned long long int index); /* Returns 0 if memory could not be allocated */
+void coinc_adc_buffer_drop(adc_buffer_t *buffer); /* Removes the oldest event */
+unsigned int coinc_adc_buffer_drop_older(adc_buffer_t *buffer, unsigned long long int timestamp, long long int low); /* Removes events earlier than timestamp+low. Returns the number of events removed. */
+void coinc_adc_buffer_clear(adc_buffer_t *buffer);
+
+/* Finds the partner of a trigger at timestamp and input position index among the events with a time difference from
+ * low to high (inclusive) to the trigger. If there are events before the trigger in the input, the last of them is
+ * chosen, otherwise the last event after the trigger. Returns the slot of the event or -1 if there are none. */
+int coinc_adc_buffer_find_partner(const adc_buffer_t *buffer, unsigned long long int timestamp, unsigned long long int index, long long int low, long long int high);
+
+#endif /* COINC_BUFFER_H */
@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "coinc_checkpoint.h"
+
+#define CHECKPOINT_TMP_SUFFIX ".tmp"
+
+int checkpoint_write(const char *filename, const checkpoint_t *cp, const coinc_t *search) {
+    size_t len=strlen(filename);
+    char *tmp_filename=malloc(len+sizeof(CHECKPOINT_TMP_SUFFIX));
+    unsigned int version=CHECKPOINT_VERSION;
+    size_t size=sizeof(checkpoint_t);
+    FILE *f;
+    int ok;
+    if(!tmp_filename)
+        return 0;
+    memcpy(tmp_filename, filename, len);
+    memcpy(tmp_filename+len, CHECKPOINT_TMP_SUFFIX, sizeof(CHECKPOINT_TMP_SUFFIX));
+    f=fopen(tmp_filename, "wb");
+    if(!f) {
+        free(tmp_filename);
+        return 0;
+    }
+    ok=fwrite(CHECKPOINT_MAGIC, 1, CHECKPOINT_MAGIC_SIZE, f) == CHECKPOINT_MAGIC_SIZE &&
+        fwrite(&version, sizeof(version), 1, f) == 1 &&
+        fwrite(&size, sizeof(size), 1, f) == 1 &&
+        fwrite(cp, sizeof(checkpoint_t), 1, f) == 1 &&
+        coinc_save(search, f);
+    ok=(fclose(f) == 0) && ok;
+    if(ok) {
+        ok=(rename(tmp_filename, filename) == 0);
+    } else {
+        remove(tmp_filename);
+    }
+    free(tmp_filename);
+    return ok;
+}
+
+int checkpoint_read(const char *filename, checkpoint_t *cp, coinc_t *search) {
+    FILE *f=fopen(filename, "rb");
+    char magic[CHECKPOINT_MAGIC_SIZE];
+    unsigned int version;
+    size_t size;
+    if(!f) {
+        fprintf(stderr, "Could not open checkpoint \"%s\".\n", filename);
+        return 0;
+    }
+    if(fread(magic, 1, CHECKPOINT_MAGIC_SIZE, f) != CHECKPOINT_MAGIC_SIZE || memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE) != 0 ||
+       fread(&version, sizeof(version), 1, f) != 1 || version != CHECKPOINT_VERSION ||
+       fread(&size, sizeof(size), 1, f) != 1 || size != sizeof(checkpoint_t) ||
+       fread(cp, sizeof(checkpoint_t), 1, f) != 1) {
+        fprintf(stderr, "\"%s\" is not a checkpoint of this version of coinc.\n", filename);
+        fclose(f);
+        return 0;
+    }
+    if(!coinc_load(search, f)) {
+        fprintf(stderr, "Checkpoint \"%s\" was taken with other options or is corrupted.\n", filename);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+    return 1;
+}
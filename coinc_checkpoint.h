@@ -0,0 +1,50 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_CHECKPOINT_H
+#define COINC_CHECKPOINT_H
+
+#include "coinc_event.h"
+#include "coinc_lib.h"
+
+#define CHECKPOINT_MAGIC "COINCCKP"
+#define CHECKPOINT_MAGIC_SIZE 8
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_INTERVAL_DEFAULT 600 /* Seconds */
+
+/* Where an output was when the checkpoint was taken */
+struct checkpoint_output {
+    long long int size; /* Bytes written, -1 if there is no output file */
+    unsigned long long int n_written; /* Coincidences written */
+    unsigned long long int monitor_position[MONITORS_MAX]; /* Cursors of the monitors (see coinc_monitor.h) */
+    unsigned long long int monitor_last_timestamp[MONITORS_MAX];
+};
+
+/* Checkpoint of a coinc run (--checkpoint, --resume): the position in the input and the outputs, followed by the state
+ * of the search (coinc_save()). Everything is in the byte order of this computer, checkpoints are not portable. */
+struct checkpoint {
+    unsigned long long int input_size; /* input_size() of the input, to recognize it */
+    unsigned long long int input_offset; /* Where the next event is read */
+    unsigned long long int n_emitted; /* Coincidences found, for --nevents */
+    unsigned int n_monitors;
+    struct checkpoint_output output, delayed_output;
+};
+
+typedef struct checkpoint checkpoint_t;
+
+/* Writes the checkpoint under a temporary name and renames it, so that an interrupted write leaves the previous
+ * checkpoint in place. Returns 0 on failure. */
+int checkpoint_write(const char *filename, const checkpoint_t *cp, const coinc_t *search);
+/* Reads a checkpoint and loads the state of the search into search, which must have the configuration it was saved
+ * with. Returns 0 and prints an error if it could not be read or does not match. */
+int checkpoint_read(const char *filename, checkpoint_t *cp, coinc_t *search);
+
+#endif /* COINC_CHECKPOINT_H */
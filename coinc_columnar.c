@@ -0,0 +1,391 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <coinc_config.h>
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#include "coinc_columnar.h"
+#include "coinc_binary.h"
+
+#define COLUMNAR_PAD(bytes) (((bytes)+7) & ~(uint64_t)7)
+
+struct columnar_writer {
+    FILE *f;
+    unsigned int n_adcs;
+    unsigned int chunk_rows;
+    uint32_t flags;
+    unsigned int rows; /* Rows in the current chunk */
+    uint64_t *trigger_timestamp;
+    uint64_t *timestamp; /* [adc*chunk_rows+row] */
+    int64_t *timediff;
+    int32_t *channel;
+    int64_t *monitor;
+    uint8_t *present;
+    uint64_t min_trigger_timestamp;
+    uint64_t max_trigger_timestamp;
+    uint64_t offset; /* Bytes written so far */
+    uint64_t n_rows;
+    columnar_index_entry_t *index;
+    uint64_t n_chunks;
+    uint64_t index_size;
+    int error;
+};
+
+struct columnar_reader {
+    unsigned char *data;
+    size_t size;
+    int mapped;
+    columnar_header_t header;
+    uint64_t n_chunks;
+    uint64_t n_rows;
+    const unsigned char *index;
+};
+
+/* Columns are written and read as they are in memory, which matches the file only on little-endian hosts */
+static int host_is_little_endian(void) {
+    const uint16_t one=1;
+    return *(const unsigned char *)&one == 1;
+}
+
+static uint64_t columnar_chunk_size(unsigned int rows, unsigned int n_adcs, uint32_t flags) {
+    uint64_t size=COLUMNAR_CHUNK_HEADER_SIZE;
+    size+=COLUMNAR_PAD(8*(uint64_t)rows)*(1+2*(uint64_t)n_adcs);
+    size+=COLUMNAR_PAD(4*(uint64_t)rows)*n_adcs;
+    if(flags & COLUMNAR_FLAG_MONITOR)
+        size+=COLUMNAR_PAD(8*(uint64_t)rows);
+    size+=COLUMNAR_PAD((uint64_t)rows)*n_adcs;
+    return size;
+}
+
+columnar_writer_t *columnar_writer_open(FILE *f, unsigned int n_adcs, unsigned int trigger_adc, unsigned int chunk_rows, uint32_t flags) {
+    unsigned char header[COLUMNAR_HEADER_SIZE];
+    columnar_writer_t *w;
+    if(!host_is_little_endian()) {
+        fprintf(stderr, "Columnar output is only supported on little-endian computers.\n");
+        return NULL;
+    }
+    w=calloc(1, sizeof(columnar_writer_t));
+    if(!w)
+        return NULL;
+    w->f=f;
+    w->n_adcs=n_adcs;
+    w->chunk_rows=chunk_rows;
+    w->flags=flags;
+    w->trigger_timestamp=malloc(chunk_rows*sizeof(uint64_t));
+    w->timestamp=malloc((size_t)n_adcs*chunk_rows*sizeof(uint64_t));
+    w->timediff=malloc((size_t)n_adcs*chunk_rows*sizeof(int64_t));
+    w->channel=malloc((size_t)n_adcs*chunk_rows*sizeof(int32_t));
+    w->monitor=malloc(chunk_rows*sizeof(int64_t));
+    w->present=malloc((size_t)n_adcs*chunk_rows);
+    if(!w->trigger_timestamp || !w->timestamp || !w->timediff || !w->channel || !w->monitor || !w->present) {
+        w->error=1;
+        columnar_writer_close(w);
+        return NULL;
+    }
+    memset(header, 0, sizeof(header));
+    memcpy(header, COLUMNAR_MAGIC, COLUMNAR_MAGIC_SIZE);
+    binary_put_u32(header+8, COLUMNAR_VERSION);
+    binary_put_u32(header+12, COLUMNAR_HEADER_SIZE);
+    binary_put_u32(header+16, n_adcs);
+    binary_put_u32(header+20, chunk_rows);
+    binary_put_u32(header+24, flags);
+    binary_put_u32(header+28, trigger_adc);
+    if(fwrite(header, 1, sizeof(header), f) != sizeof(header))
+        w->error=1;
+    w->offset=sizeof(header);
+    return w;
+}
+
+static void columnar_write_column(columnar_writer_t *w, const void *data, size_t size) {
+    static const unsigned char zeros[8]={0};
+    size_t pad=COLUMNAR_PAD(size)-size;
+    if(fwrite(data, 1, size, w->f) != size || fwrite(zeros, 1, pad, w->f) != pad)
+        w->error=1;
+}
+
+static void columnar_write_chunk(columnar_writer_t *w) {
+    unsigned char header[COLUMNAR_CHUNK_HEADER_SIZE];
+    columnar_index_entry_t *index;
+    uint64_t size=columnar_chunk_size(w->rows, w->n_adcs, w->flags);
+    unsigned int adc;
+    if(!w->rows)
+        return;
+    if(w->n_chunks == w->index_size) {
+        w->index_size=w->index_size?2*w->index_size:64;
+        index=realloc(w->index, w->index_size*sizeof(columnar_index_entry_t));
+        if(!index) {
+            w->error=1;
+            w->rows=0;
+            return;
+        }
+        w->index=index;
+    }
+    w->index[w->n_chunks].offset=w->offset;
+    w->index[w->n_chunks].rows=w->rows;
+    w->index[w->n_chunks].min_trigger_timestamp=w->min_trigger_timestamp;
+    w->index[w->n_chunks].max_trigger_timestamp=w->max_trigger_timestamp;
+    w->n_chunks++;
+    binary_put_u32(header, w->rows);
+    binary_put_u32(header+4, 0);
+    binary_put_u64(header+8, size);
+    if(fwrite(header, 1, sizeof(header), w->f) != sizeof(header))
+        w->error=1;
+    columnar_write_column(w, w->trigger_timestamp, w->rows*sizeof(uint64_t));
+    for(adc=0; adc < w->n_adcs; adc++)
+        columnar_write_column(w, w->timestamp+(size_t)adc*w->chunk_rows, w->rows*sizeof(uint64_t));
+    for(adc=0; adc < w->n_adcs; adc++)
+        columnar_write_column(w, w->timediff+(size_t)adc*w->chunk_rows, w->rows*sizeof(int64_t));
+    for(adc=0; adc < w->n_adcs; adc++)
+        columnar_write_column(w, w->channel+(size_t)adc*w->chunk_rows, w->rows*sizeof(int32_t));
+    if(w->flags & COLUMNAR_FLAG_MONITOR)
+        columnar_write_column(w, w->monitor, w->rows*sizeof(int64_t));
+    for(adc=0; adc < w->n_adcs; adc++)
+        columnar_write_column(w, w->present+(size_t)adc*w->chunk_rows, w->rows);
+    w->offset+=size;
+    w->n_rows+=w->rows;
+    w->rows=0;
+}
+
+int columnar_writer_write(columnar_writer_t *w, const coincidence_t *c) {
+    unsigned int adc, row=w->rows;
+    size_t i;
+    if(!row || c->trigger_timestamp < w->min_trigger_timestamp)
+        w->min_trigger_timestamp=c->trigger_timestamp;
+    if(!row || c->trigger_timestamp > w->max_trigger_timestamp)
+        w->max_trigger_timestamp=c->trigger_timestamp;
+    w->trigger_timestamp[row]=c->trigger_timestamp;
+    w->monitor[row]=c->monitor[0];
+    for(adc=0; adc < w->n_adcs; adc++) {
+        i=(size_t)adc*w->chunk_rows+row;
+        w->timestamp[i]=c->timestamp[adc];
+        w->timediff[i]=c->timediff[adc];
+        w->channel[i]=c->channel[adc];
+        w->present[i]=c->present[adc];
+    }
+    w->rows++;
+    if(w->rows == w->chunk_rows)
+        columnar_write_chunk(w);
+    return !w->error;
+}
+
+int columnar_writer_close(columnar_writer_t *w) {
+    unsigned char buf[COLUMNAR_INDEX_ENTRY_SIZE];
+    uint64_t i;
+    int ok;
+    if(!w)
+        return 1;
+    if(!w->error) {
+        columnar_write_chunk(w);
+        for(i=0; i < w->n_chunks; i++) {
+            binary_put_u64(buf, w->index[i].offset);
+            binary_put_u64(buf+8, w->index[i].rows);
+            binary_put_u64(buf+16, w->index[i].min_trigger_timestamp);
+            binary_put_u64(buf+24, w->index[i].max_trigger_timestamp);
+            if(fwrite(buf, 1, COLUMNAR_INDEX_ENTRY_SIZE, w->f) != COLUMNAR_INDEX_ENTRY_SIZE)
+                w->error=1;
+        }
+        binary_put_u64(buf, w->n_chunks);
+        binary_put_u64(buf+8, w->n_rows);
+        binary_put_u64(buf+16, w->offset);
+        memcpy(buf+24, COLUMNAR_END_MAGIC, COLUMNAR_MAGIC_SIZE);
+        if(fwrite(buf, 1, COLUMNAR_TRAILER_SIZE, w->f) != COLUMNAR_TRAILER_SIZE || fflush(w->f))
+            w->error=1;
+    }
+    ok=!w->error;
+    free(w->trigger_timestamp);
+    free(w->timestamp);
+    free(w->timediff);
+    free(w->channel);
+    free(w->monitor);
+    free(w->present);
+    free(w->index);
+    free(w);
+    return ok;
+}
+
+static int columnar_reader_load(columnar_reader_t *r, FILE *f) {
+    size_t n;
+    unsigned char *data;
+#ifdef HAVE_MMAP
+    struct stat st;
+    if(fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        r->data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if(r->data != MAP_FAILED) {
+            r->size=st.st_size;
+            r->mapped=1;
+            return 1;
+        }
+        r->data=NULL;
+    }
+#endif
+    while(1) { /* Read the whole file into memory */
+        data=realloc(r->data, r->size+(1<<20));
+        if(!data)
+            return 0;
+        r->data=data;
+        n=fread(r->data+r->size, 1, 1<<20, f);
+        r->size+=n;
+        if(n < (1<<20))
+            return !ferror(f);
+    }
+}
+
+columnar_reader_t *columnar_reader_open(const char *filename) {
+    columnar_reader_t *r;
+    const unsigned char *trailer;
+    uint64_t index_offset;
+    FILE *f=stdin;
+    if(filename && strcmp(filename, "-") != 0)
+        f=fopen(filename, "rb");
+    else
+        filename="standard input";
+    if(!f) {
+        fprintf(stderr, "Could not open file \"%s\" for input.\n", filename);
+        return NULL;
+    }
+    r=calloc(1, sizeof(columnar_reader_t));
+    if(!r || !columnar_reader_load(r, f)) {
+        fprintf(stderr, "Could not read file \"%s\".\n", filename);
+        if(f != stdin)
+            fclose(f);
+        columnar_reader_close(r);
+        return NULL;
+    }
+    if(f != stdin)
+        fclose(f);
+    if(!host_is_little_endian()) {
+        fprintf(stderr, "Columnar input is only supported on little-endian computers.\n");
+        columnar_reader_close(r);
+        return NULL;
+    }
+    if(r->size < COLUMNAR_HEADER_SIZE+COLUMNAR_TRAILER_SIZE || memcmp(r->data, COLUMNAR_MAGIC, COLUMNAR_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "File \"%s\" is not a columnar coincidence file.\n", filename);
+        columnar_reader_close(r);
+        return NULL;
+    }
+    r->header.version=binary_get_u32(r->data+8);
+    r->header.header_size=binary_get_u32(r->data+12);
+    r->header.n_adcs=binary_get_u32(r->data+16);
+    r->header.chunk_rows=binary_get_u32(r->data+20);
+    r->header.flags=binary_get_u32(r->data+24);
+    r->header.trigger_adc=binary_get_u32(r->data+28);
+    if(r->header.version != COLUMNAR_VERSION) {
+        fprintf(stderr, "Unsupported columnar format version %u in \"%s\", this is version %u.\n", r->header.version, filename, COLUMNAR_VERSION);
+        columnar_reader_close(r);
+        return NULL;
+    }
+    trailer=r->data+r->size-COLUMNAR_TRAILER_SIZE;
+    r->n_chunks=binary_get_u64(trailer);
+    r->n_rows=binary_get_u64(trailer+8);
+    index_offset=binary_get_u64(trailer+16);
+    if(memcmp(trailer+24, COLUMNAR_END_MAGIC, COLUMNAR_MAGIC_SIZE) != 0 || r->header.n_adcs > N_ADCS_MAX ||
+       r->header.header_size < COLUMNAR_HEADER_SIZE || r->header.header_size%8 || index_offset < r->header.header_size ||
+       index_offset > r->size-COLUMNAR_TRAILER_SIZE || (r->size-index_offset-COLUMNAR_TRAILER_SIZE)/COLUMNAR_INDEX_ENTRY_SIZE != r->n_chunks ||
+       (r->size-index_offset-COLUMNAR_TRAILER_SIZE)%COLUMNAR_INDEX_ENTRY_SIZE) {
+        fprintf(stderr, "File \"%s\" is truncated or corrupt (no valid index at the end).\n", filename);
+        columnar_reader_close(r);
+        return NULL;
+    }
+    r->index=r->data+index_offset;
+    return r;
+}
+
+void columnar_reader_close(columnar_reader_t *r) {
+    if(!r)
+        return;
+#ifdef HAVE_MMAP
+    if(r->mapped) {
+        munmap(r->data, r->size);
+        r->data=NULL;
+    }
+#endif
+    free(r->data);
+    free(r);
+}
+
+const columnar_header_t *columnar_reader_header(const columnar_reader_t *r) {
+    return &r->header;
+}
+
+uint64_t columnar_reader_n_chunks(const columnar_reader_t *r) {
+    return r->n_chunks;
+}
+
+uint64_t columnar_reader_n_rows(const columnar_reader_t *r) {
+    return r->n_rows;
+}
+
+void columnar_reader_index(const columnar_reader_t *r, uint64_t chunk, columnar_index_entry_t *entry) {
+    const unsigned char *p=r->index+chunk*COLUMNAR_INDEX_ENTRY_SIZE;
+    entry->offset=binary_get_u64(p);
+    entry->rows=binary_get_u64(p+8);
+    entry->min_trigger_timestamp=binary_get_u64(p+16);
+    entry->max_trigger_timestamp=binary_get_u64(p+24);
+}
+
+int columnar_reader_chunk(const columnar_reader_t *r, uint64_t chunk, columnar_chunk_t *columns) {
+    columnar_index_entry_t entry;
+    const unsigned char *p;
+    uint64_t size, index_offset=(uint64_t)(r->index-r->data);
+    unsigned int adc, rows, n_adcs=r->header.n_adcs;
+    columnar_reader_index(r, chunk, &entry);
+    /* Compared with what is left before the index, offset+size could overflow */
+    if(entry.offset%8 || entry.offset < r->header.header_size || entry.offset > index_offset || COLUMNAR_CHUNK_HEADER_SIZE > index_offset-entry.offset) {
+        fprintf(stderr, "Chunk %llu is corrupt.\n", (unsigned long long)chunk);
+        return 0;
+    }
+    p=r->data+entry.offset;
+    rows=binary_get_u32(p);
+    size=columnar_chunk_size(rows, n_adcs, r->header.flags);
+    if(rows != entry.rows || rows > r->header.chunk_rows || binary_get_u64(p+8) != size || size > index_offset-entry.offset) {
+        fprintf(stderr, "Chunk %llu is corrupt.\n", (unsigned long long)chunk);
+        return 0;
+    }
+    p+=COLUMNAR_CHUNK_HEADER_SIZE;
+    columns->rows=rows;
+    columns->n_adcs=n_adcs;
+    columns->trigger_timestamp=(const uint64_t *)p;
+    p+=COLUMNAR_PAD(8*(uint64_t)rows);
+    for(adc=0; adc < n_adcs; adc++, p+=COLUMNAR_PAD(8*(uint64_t)rows))
+        columns->timestamp[adc]=(const uint64_t *)p;
+    for(adc=0; adc < n_adcs; adc++, p+=COLUMNAR_PAD(8*(uint64_t)rows))
+        columns->timediff[adc]=(const int64_t *)p;
+    for(adc=0; adc < n_adcs; adc++, p+=COLUMNAR_PAD(4*(uint64_t)rows))
+        columns->channel[adc]=(const int32_t *)p;
+    columns->monitor=NULL;
+    if(r->header.flags & COLUMNAR_FLAG_MONITOR) {
+        columns->monitor=(const int64_t *)p;
+        p+=COLUMNAR_PAD(8*(uint64_t)rows);
+    }
+    for(adc=0; adc < n_adcs; adc++, p+=COLUMNAR_PAD((uint64_t)rows))
+        columns->present[adc]=(const uint8_t *)p;
+    return 1;
+}
+
+void columnar_chunk_row(const columnar_chunk_t *columns, unsigned int row, coincidence_t *c) {
+    unsigned int adc;
+    c->n_adcs=columns->n_adcs;
+    c->trigger_timestamp=columns->trigger_timestamp[row];
+    memset(c->monitor, 0, sizeof(c->monitor));
+    c->monitor[0]=columns->monitor?columns->monitor[row]:0;
+    for(adc=0; adc < columns->n_adcs; adc++) {
+        c->present[adc]=columns->present[adc][row];
+        c->channel[adc]=columns->channel[adc][row];
+        c->timestamp[adc]=columns->timestamp[adc][row];
+        c->timediff[adc]=columns->timediff[adc][row];
+    }
+}
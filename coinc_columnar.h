@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_COLUMNAR_H
+#define COINC_COLUMNAR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "coinc_event.h"
+
+/* Columnar coincidence output format, version 2. All integers are little-endian. Coincidences are stored in chunks of
+ * at most chunk_rows rows, each chunk holding one typed array per column, so that a reader can memory-map the file
+ * and use the arrays directly. An index at the end of the file gives the range of trigger timestamps in each chunk.
+ *
+ * Header (COLUMNAR_HEADER_SIZE bytes):
+ *   offset  size  field
+ *        0     8  magic "COINCCOL"
+ *        8     4  format version (COLUMNAR_VERSION)
+ *       12     4  header size in bytes, the first chunk starts at this offset
+ *       16     4  number of ADCs
+ *       20     4  maximum number of rows in a chunk
+ *       24     4  flags (COLUMNAR_FLAG_*)
+ *       28     4  triggering ADC, COLUMNAR_NO_TRIGGER if events were built without a trigger (the trigger timestamp is
+ *                 then the first timestamp of the event)
+ *       32    32  reserved, must be zero
+ *
+ * Chunk, rows = number of rows in the chunk. Every column is padded with zeros to a multiple of 8 bytes.
+ *   size  field
+ *      4  rows
+ *      4  reserved, must be zero
+ *      8  size of the chunk in bytes, including these 16 bytes
+ *      8  trigger timestamp (unsigned) x rows
+ *      8  timestamp (unsigned) x rows, for each ADC
+ *      8  time difference to the trigger (signed) x rows, for each ADC
+ *      4  channel (signed) x rows, for each ADC
+ *      8  monitor count (signed) x rows, only if COLUMNAR_FLAG_MONITOR is set (4 bytes in version 1)
+ *      1  1 if the ADC has an event in the coincidence, 0 if not x rows, for each ADC
+ * Columns of ADCs without an event are zero.
+ *
+ * Index, after the last chunk:
+ *     32  one entry per chunk: offset of the chunk (8), rows (8), minimum trigger timestamp (8), maximum (8)
+ *     32  trailer: number of chunks (8), number of rows (8), offset of the index (8), magic "COINCEND" (8)
+ *
+ * Chunks are written in the order of the coincidences. Trigger timestamps usually increase from chunk to chunk, but
+ * not necessarily (e.g. timestamp reset during a run), so readers should check every index entry. */
+
+#define COLUMNAR_MAGIC "COINCCOL"
+#define COLUMNAR_END_MAGIC "COINCEND"
+#define COLUMNAR_MAGIC_SIZE 8
+#define COLUMNAR_VERSION 2
+#define COLUMNAR_HEADER_SIZE 64
+#define COLUMNAR_CHUNK_HEADER_SIZE 16
+#define COLUMNAR_INDEX_ENTRY_SIZE 32
+#define COLUMNAR_TRAILER_SIZE 32
+#define COLUMNAR_CHUNK_ROWS_DEFAULT 16384
+#define COLUMNAR_FLAG_MONITOR 0x1
+#define COLUMNAR_NO_TRIGGER 0xffffffffU
+
+struct columnar_header {
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t n_adcs;
+    uint32_t chunk_rows;
+    uint32_t flags;
+    uint32_t trigger_adc;
+};
+
+typedef struct columnar_header columnar_header_t;
+
+struct columnar_index_entry {
+    uint64_t offset;
+    uint64_t rows;
+    uint64_t min_trigger_timestamp;
+    uint64_t max_trigger_timestamp;
+};
+
+typedef struct columnar_index_entry columnar_index_entry_t;
+
+/* Columns of one chunk, pointing into the file. Per-ADC columns are indexed [adc][row]. */
+struct columnar_chunk {
+    unsigned int rows;
+    unsigned int n_adcs;
+    const uint64_t *trigger_timestamp;
+    const uint64_t *timestamp[N_ADCS_MAX];
+    const int64_t *timediff[N_ADCS_MAX];
+    const int32_t *channel[N_ADCS_MAX];
+    const int64_t *monitor; /* NULL if there is no monitor column */
+    const uint8_t *present[N_ADCS_MAX];
+};
+
+typedef struct columnar_chunk columnar_chunk_t;
+
+typedef struct columnar_writer columnar_writer_t;
+typedef struct columnar_reader columnar_reader_t;
+
+/* Writes the header to f, which must stay open until columnar_writer_close(). f does not need to be seekable.
+ * Returns NULL on failure. */
+columnar_writer_t *columnar_writer_open(FILE *f, unsigned int n_adcs, unsigned int trigger_adc, unsigned int chunk_rows, uint32_t flags);
+int columnar_writer_write(columnar_writer_t *w, const coincidence_t *c); /* Returns 0 if a write failed */
+int columnar_writer_close(columnar_writer_t *w); /* Writes the last chunk and the index. Returns 0 if any write failed. */
+
+/* Memory-maps the file, or reads it into memory if that is not possible (e.g. filename NULL or "-" for standard input).
+ * Returns NULL and prints an error if the file is not a valid columnar file. */
+columnar_reader_t *columnar_reader_open(const char *filename);
+void columnar_reader_close(columnar_reader_t *r);
+const columnar_header_t *columnar_reader_header(const columnar_reader_t *r);
+uint64_t columnar_reader_n_chunks(const columnar_reader_t *r);
+uint64_t columnar_reader_n_rows(const columnar_reader_t *r);
+void columnar_reader_index(const columnar_reader_t *r, uint64_t chunk, columnar_index_entry_t *entry);
+int columnar_reader_chunk(const columnar_reader_t *r, uint64_t chunk, columnar_chunk_t *columns); /* Returns 0 and prints an error if the chunk is corrupt */
+void columnar_chunk_row(const columnar_chunk_t *columns, unsigned int row, coincidence_t *c); /* Copies a row to c, whose arrays must have room for n_adcs elements */
+
+#endif /* COINC_COLUMNAR_H */
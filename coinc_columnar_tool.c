@@ -0,0 +1,148 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <coinc_config.h>
+#include "coinc_columnar.h"
+#include "coinc_output.h"
+
+#define HELP_TEXT "Usage: %s [OPTION] infile outfile\n\nReads columnar output of coinc (--output-format=columnar) and writes it as text, in the same format coinc would have.\nIf no infile or outfile is specified, standard input or output is used respectively.\nValid options:\n\t--index\t\tprint the chunk index instead of the coincidences\n\t--from=TS\tonly coincidences with a trigger timestamp of at least TS\n\t--to=TS\t\tonly coincidences with a trigger timestamp of at most TS\n\t--timestamps\toutput timestamps\n\t--both\t\toutput both data and timestamps (2 col/ch)\n\t--timediff\toutput both data and time difference to trigger time\n\t--triggertime\tinclude trigger event timestamp as first column\n\n"
+
+static void print_index(const columnar_reader_t *r, FILE *f) {
+    const columnar_header_t *header=columnar_reader_header(r);
+    columnar_index_entry_t entry;
+    uint64_t chunk;
+    char trigger[32];
+    if(header->trigger_adc == COLUMNAR_NO_TRIGGER)
+        snprintf(trigger, sizeof(trigger), "no trigger");
+    else
+        snprintf(trigger, sizeof(trigger), "trigger ADC %u", header->trigger_adc);
+    fprintf(f, "# %u ADCs, %s, at most %u rows per chunk, %llu chunks, %llu rows%s\n", header->n_adcs, trigger, header->chunk_rows,
+            (unsigned long long)columnar_reader_n_chunks(r), (unsigned long long)columnar_reader_n_rows(r), header->flags & COLUMNAR_FLAG_MONITOR?", monitor column":"");
+    fprintf(f, "# chunk offset rows min_trigger_timestamp max_trigger_timestamp\n");
+    for(chunk=0; chunk < columnar_reader_n_chunks(r); chunk++) {
+        columnar_reader_index(r, chunk, &entry);
+        fprintf(f, "%llu %llu %llu %llu %llu\n", (unsigned long long)chunk, (unsigned long long)entry.offset, (unsigned long long)entry.rows,
+                (unsigned long long)entry.min_trigger_timestamp, (unsigned long long)entry.max_trigger_timestamp);
+    }
+}
+
+/* Only chunks whose trigger timestamp range overlaps from..to are touched */
+static int print_coincidences(const columnar_reader_t *r, output_t *out, output_mode mode, int triggertime, unsigned long long from, unsigned long long to) {
+    const columnar_header_t *header=columnar_reader_header(r);
+    columnar_index_entry_t entry;
+    columnar_chunk_t columns;
+    coincidence_t c;
+    uint64_t chunk;
+    unsigned int row;
+    unsigned char present[N_ADCS_MAX];
+    int channel[N_ADCS_MAX];
+    unsigned long long int timestamp[N_ADCS_MAX];
+    long long int timediff[N_ADCS_MAX];
+    c.present=present;
+    c.channel=channel;
+    c.timestamp=timestamp;
+    c.timediff=timediff;
+    for(chunk=0; chunk < columnar_reader_n_chunks(r); chunk++) {
+        columnar_reader_index(r, chunk, &entry);
+        if(entry.max_trigger_timestamp < from || entry.min_trigger_timestamp > to)
+            continue;
+        if(!columnar_reader_chunk(r, chunk, &columns))
+            return 0;
+        for(row=0; row < columns.rows; row++) {
+            if(columns.trigger_timestamp[row] < from || columns.trigger_timestamp[row] > to)
+                continue;
+            columnar_chunk_row(&columns, row, &c);
+            output_coincidence(out, mode, triggertime, (header->flags & COLUMNAR_FLAG_MONITOR)?1:0, &c);
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int i, index=0, triggertime=0, ok, read_ok=1;
+    unsigned long long from=0, to=~0ULL;
+    char *input_filename=NULL, *output_filename=NULL;
+    output_mode mode=MODE_RAW;
+    columnar_reader_t *r;
+    output_t *out;
+    FILE *f=stdout;
+
+    if(argc == 1) {
+        fprintf(stderr, "coinc-columnar %s\n", coinc_VERSION);
+        fprintf(stderr, HELP_TEXT, argv[0]);
+        return 0;
+    }
+    for(i=1; i < argc; i++) {
+        if(strcmp(argv[i], "--index") == 0) {
+            index=1;
+            continue;
+        }
+        if(sscanf(argv[i], "--from=%llu", &from) == 1)
+            continue;
+        if(sscanf(argv[i], "--to=%llu", &to) == 1)
+            continue;
+        if(strcmp(argv[i], "--timestamps") == 0) {
+            mode=MODE_TIMESTAMPS;
+            continue;
+        }
+        if(strcmp(argv[i], "--both") == 0) {
+            mode=MODE_TIME_AND_CHANNEL;
+            continue;
+        }
+        if(strcmp(argv[i], "--timediff") == 0) {
+            mode=MODE_TIMEDIFF_AND_CHANNEL;
+            continue;
+        }
+        if(strcmp(argv[i], "--triggertime") == 0) {
+            triggertime=1;
+            continue;
+        }
+        if(strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Unrecognized option \"%s\"\n", argv[i]);
+            return 0;
+        }
+        if(!input_filename) {
+            input_filename=argv[i];
+        } else {
+            output_filename=argv[i];
+        }
+    }
+    r=columnar_reader_open(input_filename);
+    if(!r)
+        return 0;
+    if(output_filename && strcmp(output_filename, "-") != 0) {
+        f=fopen(output_filename, "w");
+        if(!f) {
+            fprintf(stderr, "Could not open file \"%s\" for output.\n", output_filename);
+            columnar_reader_close(r);
+            return 0;
+        }
+    }
+    if(index) {
+        print_index(r, f);
+        ok=!ferror(f);
+    } else {
+        out=output_open(f);
+        read_ok=!out || print_coincidences(r, out, mode, triggertime, from, to); /* A corrupt chunk has been reported */
+        ok=out && output_close(out);
+    }
+    columnar_reader_close(r);
+    if(f != stdout && fclose(f))
+        ok=0;
+    if(!ok) {
+        fprintf(stderr, "Error writing output.\n");
+        return 0;
+    }
+    return read_ok;
+}
@@ -0,0 +1,194 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <coinc_config.h>
+#include "coinc_event.h"
+#include "coinc_binary.h"
+#include "coinc_input.h"
+#include "coinc_output.h"
+
+#define CONVERT_BUFFER_EVENTS 65536
+#define TEXT_HEADER_LINE "adc channel timestamp\n"
+#define HELP_TEXT "Usage: %s [OPTION] infile outfile\n\nConverts list-mode data between the text and binary formats understood by coinc.\nIf no infile or outfile is specified, standard input or output is used respectively.\nThe direction is detected from the input file, standard input is assumed to be text.\nLike coinc, the first line of text input is a header and is not converted. A header line is written to text output.\nValid options:\n\t--to-bin\tconvert text to binary\n\t--to-text\tconvert binary to text\n\t--nadc=NUM\tstore NUM as the number of ADCs in the binary header (default: highest ADC + 1)\n\t--tick=PS\tstore PS picoseconds as the timestamp unit in the binary header\n\n"
+
+typedef enum DIRECTION_E {
+    DIRECTION_AUTO = 0,
+    DIRECTION_TO_BINARY = 1,
+    DIRECTION_TO_TEXT = 2
+} direction;
+
+static direction detect_direction(const char *filename) {
+    unsigned char magic[BINARY_MAGIC_SIZE];
+    size_t n_read;
+    FILE *f;
+    if(!filename)
+        return DIRECTION_TO_BINARY;
+    f=fopen(filename, "rb");
+    if(!f)
+        return DIRECTION_TO_BINARY; /* input_open() will complain */
+    n_read=fread(magic, 1, BINARY_MAGIC_SIZE, f);
+    fclose(f);
+    return binary_is_binary(magic, n_read)?DIRECTION_TO_TEXT:DIRECTION_TO_BINARY;
+}
+
+static int convert_to_binary(input_t *in, FILE *out, binary_header_t *header) {
+    unsigned char *buffer=malloc(CONVERT_BUFFER_EVENTS*BINARY_RECORD_SIZE);
+    size_t n=0;
+    unsigned long long n_events=0;
+    int max_adc=-1;
+    event event;
+    if(!buffer)
+        return 0;
+    if(!binary_header_write(header, out)) {
+        free(buffer);
+        return 0;
+    }
+    while(input_read_event(in, &event)) {
+        if(event.adc < 0 || event.adc >= N_ADCS_MAX) {
+            fprintf(stderr, "ADC value %i on line %llu out of range.\n", event.adc, input_line(in));
+            free(buffer);
+            return 0;
+        }
+        if(event.adc > max_adc)
+            max_adc=event.adc;
+        binary_record_encode(buffer+n*BINARY_RECORD_SIZE, &event);
+        n_events++;
+        if(++n == CONVERT_BUFFER_EVENTS) {
+            if(fwrite(buffer, BINARY_RECORD_SIZE, n, out) != n) {
+                free(buffer);
+                return 0;
+            }
+            n=0;
+        }
+    }
+    if(fwrite(buffer, BINARY_RECORD_SIZE, n, out) != n) {
+        free(buffer);
+        return 0;
+    }
+    free(buffer);
+    if(input_error(in))
+        return 0;
+    if(!header->n_adcs)
+        header->n_adcs=max_adc+1;
+    header->n_events=n_events;
+    if(fseek(out, 0, SEEK_SET) == 0) { /* Output is seekable, fill in the header */
+        if(!binary_header_write(header, out))
+            return 0;
+    }
+    fprintf(stderr, "%llu events converted to binary.\n", n_events);
+    return 1;
+}
+
+static int convert_to_text(input_t *in, FILE *f) {
+    unsigned long long n_events=0;
+    event event;
+    output_t *out=output_open(f);
+    if(!out)
+        return 0;
+    output_string(out, TEXT_HEADER_LINE);
+    while(input_read_event(in, &event)) {
+        output_int(out, event.adc, 0);
+        output_char(out, ' ');
+        output_int(out, event.channel, 0);
+        output_char(out, ' ');
+        output_uint(out, event.timestamp, 0);
+        output_char(out, '\n');
+        n_events++;
+    }
+    if(!output_close(out) || input_error(in))
+        return 0;
+    fprintf(stderr, "%llu events converted to text.\n", n_events);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int i;
+    unsigned int n_adcs_argument;
+    unsigned long long tick_argument;
+    char *input_filename=NULL, *output_filename=NULL;
+    direction direction=DIRECTION_AUTO;
+    binary_header_t header;
+    input_t *in;
+    FILE *out=stdout;
+    int ok;
+
+    binary_header_init(&header);
+    if(argc == 1) {
+        fprintf(stderr, "coinc-convert %s\n", coinc_VERSION);
+        fprintf(stderr, HELP_TEXT, argv[0]);
+        return 0;
+    }
+    for(i=1; i < argc; i++) {
+        if(strcmp(argv[i], "--to-bin") == 0) {
+            direction=DIRECTION_TO_BINARY;
+            continue;
+        }
+        if(strcmp(argv[i], "--to-text") == 0) {
+            direction=DIRECTION_TO_TEXT;
+            continue;
+        }
+        if(sscanf(argv[i], "--nadc=%u", &n_adcs_argument) == 1) {
+            header.n_adcs=n_adcs_argument;
+            continue;
+        }
+        if(sscanf(argv[i], "--tick=%llu", &tick_argument) == 1) {
+            header.tick_ps=tick_argument;
+            continue;
+        }
+        if(strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Unrecognized option \"%s\"\n", argv[i]);
+            return 0;
+        }
+        if(!input_filename) {
+            input_filename=argv[i];
+        } else {
+            output_filename=argv[i];
+        }
+    }
+    if(input_filename && strcmp(input_filename, "-") == 0)
+        input_filename=NULL;
+    if(output_filename && strcmp(output_filename, "-") == 0)
+        output_filename=NULL;
+    if(direction == DIRECTION_AUTO)
+        direction=detect_direction(input_filename);
+    in=input_open(input_filename, direction == DIRECTION_TO_TEXT?INPUT_FORMAT_BINARY:INPUT_FORMAT_TEXT);
+    if(!in) {
+        fprintf(stderr, "Could not open \"%s\" for input.\n", input_filename?input_filename:"standard input");
+        return 0;
+    }
+    if(output_filename) {
+        out=fopen(output_filename, direction == DIRECTION_TO_BINARY?"wb":"w");
+        if(!out) {
+            fprintf(stderr, "Could not open file \"%s\" for output.\n", output_filename);
+            input_close(in);
+            return 0;
+        }
+    }
+    if(direction == DIRECTION_TO_BINARY) {
+        if(!input_skip(in, 1)) { /* Header line */
+            fprintf(stderr, "Input is empty.\n");
+        }
+        ok=convert_to_binary(in, out, &header);
+    } else {
+        ok=convert_to_text(in, out);
+    }
+    input_close(in);
+    if(out != stdout)
+        fclose(out);
+    if(!ok) {
+        fprintf(stderr, "Conversion failed.\n");
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,610 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "coinc_engine.h"
+#include "coinc_buffer.h"
+
+struct engine {
+    engine_config_t config;
+    engine_stats_t stats;
+    engine_emit_function emit;
+    void *context;
+    long long int time_window_min, time_window_max; /* Widest reach of the windows of all non-triggering ADCs */
+    long long int time_window_reach; /* Input jumping back in time by more than this (e.g. timestamp reset) is a discontinuity */
+    long long int delay_min; /* Earliest delay or 0, events are kept this much longer */
+    engine_delayed_emit_function delayed_emit;
+    void *delayed_context;
+    adc_buffer_t *buffers;
+    adc_buffer_t *trigger;
+    unsigned int n_buffered; /* Events in all buffers */
+    unsigned long long int event_index;
+    unsigned long long int last_timestamp;
+    unsigned long long int truncated_timestamp;
+    int events_truncated;
+    int table_full;
+    int *coinc_events;
+    coincidence_t coincidence;
+    int stopped;
+    int failed;
+    int cluster_open; /* Triggerless: the coincidence holds the cluster being built */
+    unsigned long long int cluster_last; /* Triggerless: latest timestamp in the cluster */
+};
+
+void coinc_engine_config_init(engine_config_t *config) {
+    unsigned int adc;
+    config->n_adcs=0;
+    config->trigger_adc=ENGINE_TRIGGER_ADC_DEFAULT;
+    for(adc=0; adc < N_ADCS_MAX; adc++) {
+        config->time_window_low[adc]=0;
+        config->time_window_high[adc]=0;
+        config->require[adc]=0;
+    }
+    config->min_multiplicity=ENGINE_MIN_MULTIPLICITY_DEFAULT;
+    config->table_size=ENGINE_TABLE_SIZE_DEFAULT;
+    config->n_delays=0;
+    config->histogram_bins=HISTOGRAM_BINS_DEFAULT;
+    config->histogram_width=1;
+    config->histogram_log=0;
+    config->build_window=0;
+    config->build_extending=0;
+}
+
+void coinc_engine_config_reach(const engine_config_t *config, long long int *min, long long int *max, long long int *reach) {
+    unsigned int adc, i;
+    long long int delay_min=0, delay_max=0;
+    *min=LLONG_MAX;
+    *max=LLONG_MIN;
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if((int)adc == config->trigger_adc)
+            continue;
+        if(config->time_window_low[adc] < *min)
+            *min=config->time_window_low[adc];
+        if(config->time_window_high[adc] > *max)
+            *max=config->time_window_high[adc];
+    }
+    if(*min <= *max && config->trigger_adc != ENGINE_TRIGGERLESS) { /* The delayed windows reach further */
+        for(i=0; i < config->n_delays; i++) {
+            delay_min=config->delay[i] < delay_min?config->delay[i]:delay_min;
+            delay_max=config->delay[i] > delay_max?config->delay[i]:delay_max;
+        }
+        *min+=delay_min;
+        *max+=delay_max;
+    }
+    *reach=*max-*min;
+    if(*reach < 0)
+        *reach=0;
+}
+
+engine_t *coinc_engine_create(const engine_config_t *config, engine_emit_function emit, void *context) {
+    engine_t *e=calloc(1, sizeof(engine_t));
+    unsigned int adc, i, n_adcs=config->n_adcs;
+    histogram_axis_t axis;
+    if(!e)
+        return NULL;
+    e->config=*config;
+    if(config->trigger_adc == ENGINE_TRIGGERLESS) {
+        for(adc=0; adc < n_adcs; adc++) {
+            e->config.time_window_low[adc]=0;
+            e->config.time_window_high[adc]=(long long int)config->build_window;
+        }
+    } else {
+        e->config.time_window_low[config->trigger_adc]=0;
+        e->config.time_window_high[config->trigger_adc]=0;
+    }
+    if(config->trigger_adc == ENGINE_TRIGGERLESS)
+        e->config.n_delays=0;
+    for(i=0; i < e->config.n_delays; i++) {
+        if(e->config.delay[i] < e->delay_min)
+            e->delay_min=e->config.delay[i];
+    }
+    e->emit=emit;
+    e->context=context;
+    coinc_engine_config_reach(&e->config, &e->time_window_min, &e->time_window_max, &e->time_window_reach);
+    e->buffers=calloc(n_adcs, sizeof(adc_buffer_t));
+    e->coinc_events=malloc(n_adcs*sizeof(int));
+    e->stats.n_adc_events=calloc(n_adcs, sizeof(unsigned long long int));
+    e->stats.n_coinc_adc_events=calloc(n_adcs, sizeof(unsigned long long int));
+    e->stats.timediff_histogram=calloc(n_adcs, sizeof(histogram_t));
+    e->stats.n_delayed_adc_events=calloc(n_adcs, sizeof(unsigned long long int));
+    e->coincidence.n_adcs=n_adcs;
+    e->coincidence.present=malloc(n_adcs*sizeof(unsigned char));
+    e->coincidence.channel=malloc(n_adcs*sizeof(int));
+    e->coincidence.timestamp=malloc(n_adcs*sizeof(unsigned long long int));
+    e->coincidence.timediff=malloc(n_adcs*sizeof(long long int));
+    if(!e->buffers || !e->coinc_events || !e->stats.n_adc_events || !e->stats.n_coinc_adc_events || !e->stats.timediff_histogram ||
+       !e->stats.n_delayed_adc_events || !e->coincidence.present || !e->coincidence.channel || !e->coincidence.timestamp || !e->coincidence.timediff) {
+        coinc_engine_free(e);
+        return NULL;
+    }
+    for(adc=0; adc < n_adcs; adc++) {
+        if(!coinc_histogram_axis_init(&axis, e->config.time_window_low[adc], e->config.time_window_high[adc], config->histogram_width, config->histogram_log, config->histogram_bins) ||
+           !coinc_histogram_init(&e->stats.timediff_histogram[adc], &axis) || !coinc_adc_buffer_init(&e->buffers[adc])) {
+            coinc_engine_free(e);
+            return NULL;
+        }
+    }
+    e->trigger=(config->trigger_adc == ENGINE_TRIGGERLESS)?NULL:&e->buffers[config->trigger_adc];
+    return e;
+}
+
+void coinc_engine_free(engine_t *e) {
+    unsigned int adc;
+    if(!e)
+        return;
+    for(adc=0; adc < e->config.n_adcs; adc++) {
+        if(e->buffers)
+            coinc_adc_buffer_free(&e->buffers[adc]);
+        if(e->stats.timediff_histogram)
+            coinc_histogram_free(&e->stats.timediff_histogram[adc]);
+    }
+    free(e->buffers);
+    free(e->coinc_events);
+    free(e->stats.n_adc_events);
+    free(e->stats.n_coinc_adc_events);
+    free(e->stats.timediff_histogram);
+    free(e->stats.n_delayed_adc_events);
+    free(e->coincidence.present);
+    free(e->coincidence.channel);
+    free(e->coincidence.timestamp);
+    free(e->coincidence.timediff);
+    free(e);
+}
+
+void coinc_engine_set_delayed_emit(engine_t *e, engine_delayed_emit_function emit, void *context) {
+    e->delayed_emit=emit;
+    e->delayed_context=context;
+}
+
+/* Finds the partners of the trigger in the given slot in the windows shifted by delay. Returns 1 if they make a
+ * coincidence. */
+static int engine_find_partners(engine_t *e, unsigned int trigger_slot, long long int delay) {
+    const engine_config_t *config=&e->config;
+    unsigned long long int trigger_timestamp=e->trigger->timestamp[trigger_slot];
+    unsigned int adc, adcs_in_coinc=0;
+    int all_required_found=1;
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if((int)adc == config->trigger_adc) {
+            e->coinc_events[adc]=(int)trigger_slot;
+            continue;
+        }
+        e->coinc_events[adc]=coinc_adc_buffer_find_partner(&e->buffers[adc], trigger_timestamp, e->trigger->index[trigger_slot], config->time_window_low[adc]+delay, config->time_window_high[adc]+delay);
+    }
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if(e->coinc_events[adc] != -1) { /* There is an event for this ADC */
+            adcs_in_coinc++;
+        } else if(config->require[adc]) {
+            all_required_found=0;
+        }
+    }
+    return (int)adcs_in_coinc >= config->min_multiplicity && all_required_found;
+}
+
+/* Fills the coincidence from the partners found, time differences counted from the trigger plus delay */
+static void engine_fill_coincidence(engine_t *e, unsigned int trigger_slot, long long int delay) {
+    unsigned int adc;
+    adc_buffer_t *buffer;
+    coincidence_t *c=&e->coincidence;
+    c->trigger_timestamp=e->trigger->timestamp[trigger_slot];
+    memset(c->monitor, 0, sizeof(c->monitor));
+    for(adc=0; adc < e->config.n_adcs; adc++) {
+        if(e->coinc_events[adc] == -1) {
+            c->present[adc]=0;
+            c->channel[adc]=0;
+            c->timestamp[adc]=0;
+            c->timediff[adc]=0;
+            continue;
+        }
+        buffer=&e->buffers[adc];
+        c->present[adc]=1;
+        c->channel[adc]=buffer->channel[e->coinc_events[adc]];
+        c->timestamp[adc]=buffer->timestamp[e->coinc_events[adc]];
+        c->timediff[adc]=((int)adc == e->config.trigger_adc)?0:(long long int)(c->timestamp[adc]-c->trigger_timestamp)-delay;
+    }
+}
+
+/* Finds the partners of the trigger in the given slot and emits the coincidence if it is good enough, then does the
+ * same in the delayed windows */
+static void engine_process_trigger(engine_t *e, unsigned int trigger_slot) {
+    const engine_config_t *config=&e->config;
+    unsigned long long int trigger_timestamp=e->trigger->timestamp[trigger_slot];
+    unsigned int adc, i;
+    long long int time_difference;
+    coincidence_t *c=&e->coincidence;
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if((int)adc != config->trigger_adc)
+            e->n_buffered-=coinc_adc_buffer_drop_older(&e->buffers[adc], trigger_timestamp, config->time_window_low[adc]+e->delay_min);
+    }
+    if(engine_find_partners(e, trigger_slot, 0)) {
+        engine_fill_coincidence(e, trigger_slot, 0);
+        for(adc=0; adc < config->n_adcs; adc++) {
+            if(!c->present[adc])
+                continue;
+            if((int)adc != config->trigger_adc) {
+                time_difference=c->timediff[adc];
+                if(time_difference < config->time_window_low[adc]) {
+                    fprintf(stderr, "Time difference too low! ADC=%u, triggering adc=%i, time diff %lli\n. This should be impossible!\n", adc, config->trigger_adc, time_difference);
+                }
+                if(time_difference > config->time_window_high[adc]) {
+                    fprintf(stderr, "Time difference too high! ADC=%u, triggering adc=%i, time diff %lli\n. This should be impossible!\n", adc, config->trigger_adc, time_difference);
+                }
+                coinc_histogram_fill(&e->stats.timediff_histogram[adc], time_difference);
+            }
+            e->stats.n_coinc_adc_events[adc]++;
+        }
+        e->stats.n_coincidences++;
+        if(!e->emit(e->context, c)) {
+            e->stopped=1;
+            return;
+        }
+    }
+    for(i=0; i < config->n_delays; i++) {
+        if(!engine_find_partners(e, trigger_slot, config->delay[i]))
+            continue;
+        engine_fill_coincidence(e, trigger_slot, config->delay[i]);
+        for(adc=0; adc < config->n_adcs; adc++) {
+            if(c->present[adc])
+                e->stats.n_delayed_adc_events[adc]++;
+        }
+        e->stats.n_delayed_coincidences[i]++;
+        if(e->delayed_emit && !e->delayed_emit(e->delayed_context, i, c)) {
+            e->stopped=1;
+            return;
+        }
+    }
+}
+
+/* Triggers wait in the buffer of the triggering ADC until the newest event is beyond the reach of their windows.
+ * With all set (end of input or of a segment) every waiting trigger is processed. If the table is full, the oldest
+ * trigger is processed in any case. Returns 0 if the engine was stopped. */
+static int engine_process_triggers(engine_t *e, int all) {
+    adc_buffer_t *trigger=e->trigger;
+    unsigned int trigger_slot;
+    unsigned long long int trigger_timestamp;
+    while(trigger->head < trigger->tail) {
+        trigger_slot=ADC_BUFFER_SLOT(trigger, trigger->head);
+        trigger_timestamp=trigger->timestamp[trigger_slot];
+        if((long long int)(e->last_timestamp-trigger_timestamp) <= e->time_window_max && !all && !e->table_full)
+            break; /* Partners may still be coming */
+        if(e->table_full || (e->events_truncated && (long long int)(e->truncated_timestamp-trigger_timestamp) >= e->time_window_min)) {
+            e->stats.n_truncated++;
+        }
+        e->table_full=0;
+        engine_process_trigger(e, trigger_slot);
+        coinc_adc_buffer_drop(trigger);
+        e->n_buffered--;
+        if(e->stopped)
+            return 0;
+    }
+    return 1;
+}
+
+/* Makes room for one more event. Events of the other ADCs are dropped when they are older than the window of the
+ * oldest waiting trigger, so the buffers grow and shrink with the count rate, but they can't grow beyond the table
+ * size: the oldest trigger is then processed without waiting for more partners, or if there are no triggers, the
+ * oldest event is dropped. */
+static int engine_make_room(engine_t *e) {
+    adc_buffer_t *buffers=e->buffers;
+    unsigned int adc;
+    int oldest_adc=-1;
+    while(e->n_buffered >= e->config.table_size) {
+        if(e->trigger->head < e->trigger->tail) {
+            e->table_full=1;
+            if(!engine_process_triggers(e, 0))
+                return 0;
+            continue;
+        }
+        for(adc=0; adc < e->config.n_adcs; adc++) {
+            if(ADC_BUFFER_SIZE(&buffers[adc]) && (oldest_adc < 0 || buffers[adc].index[ADC_BUFFER_SLOT(&buffers[adc], buffers[adc].head)] < buffers[oldest_adc].index[ADC_BUFFER_SLOT(&buffers[oldest_adc], buffers[oldest_adc].head)])) {
+                oldest_adc=(int)adc;
+            }
+        }
+        e->truncated_timestamp=buffers[oldest_adc].timestamp[ADC_BUFFER_SLOT(&buffers[oldest_adc], buffers[oldest_adc].head)];
+        e->events_truncated=1;
+        coinc_adc_buffer_drop(&buffers[oldest_adc]);
+        e->n_buffered--;
+        break;
+    }
+    return 1;
+}
+
+/* Emits the cluster being built if it is good enough */
+static void engine_build_close(engine_t *e) {
+    const engine_config_t *config=&e->config;
+    coincidence_t *c=&e->coincidence;
+    unsigned int adc, adcs_in_coinc=0;
+    int all_required_found=1;
+    if(!e->cluster_open)
+        return;
+    e->cluster_open=0;
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if(c->present[adc]) {
+            adcs_in_coinc++;
+        } else if(config->require[adc]) {
+            all_required_found=0;
+        }
+    }
+    if((int)adcs_in_coinc < config->min_multiplicity || !all_required_found)
+        return;
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if(!c->present[adc])
+            continue;
+        c->timediff[adc]=(long long int)(c->timestamp[adc]-c->trigger_timestamp);
+        coinc_histogram_fill(&e->stats.timediff_histogram[adc], c->timediff[adc]);
+        e->stats.n_coinc_adc_events[adc]++;
+    }
+    e->stats.n_coincidences++;
+    if(!e->emit(e->context, c))
+        e->stopped=1;
+}
+
+/* Triggerless event building. The cluster is kept in the coincidence, so nothing is buffered. */
+static int engine_build_push(engine_t *e, const event *event) {
+    coincidence_t *c=&e->coincidence;
+    unsigned long long int reference;
+    unsigned int adc;
+    e->stats.n_events++;
+    e->stats.n_adc_events[event->adc]++;
+    if(event->timestamp < e->last_timestamp)
+        e->stats.n_out_of_order++;
+    e->last_timestamp=event->timestamp;
+    if(e->cluster_open) {
+        reference=e->config.build_extending?e->cluster_last:c->trigger_timestamp;
+        if(event->timestamp < c->trigger_timestamp || (event->timestamp > reference && event->timestamp-reference > e->config.build_window)) {
+            engine_build_close(e);
+            if(e->stopped)
+                return 0;
+        }
+    }
+    if(!e->cluster_open) {
+        e->cluster_open=1;
+        c->trigger_timestamp=event->timestamp;
+        memset(c->monitor, 0, sizeof(c->monitor));
+        e->cluster_last=event->timestamp;
+        for(adc=0; adc < e->config.n_adcs; adc++) {
+            c->present[adc]=0;
+            c->channel[adc]=0;
+            c->timestamp[adc]=0;
+            c->timediff[adc]=0;
+        }
+    }
+    if(event->timestamp > e->cluster_last)
+        e->cluster_last=event->timestamp;
+    if(!c->present[event->adc]) { /* Later events of the same ADC are pile-up */
+        c->present[event->adc]=1;
+        c->channel[event->adc]=event->channel;
+        c->timestamp[event->adc]=event->timestamp;
+    }
+    return 1;
+}
+
+/* Halo events (see coinc_engine_push_halo()) are buffered like any other event, but they are not counted. Halo triggers
+ * are not buffered at all, but they still move the time forward. */
+static int engine_push_event(engine_t *e, const event *event, int halo) {
+    unsigned int adc;
+    if(e->stopped || e->failed)
+        return 0;
+    if(!engine_make_room(e))
+        return 0;
+    if(!halo) {
+        e->stats.n_events++;
+        e->stats.n_adc_events[event->adc]++;
+    }
+    if(event->timestamp < e->last_timestamp) {
+        if(!halo)
+            e->stats.n_out_of_order++;
+        if(e->last_timestamp-event->timestamp > (unsigned long long int)e->time_window_reach) { /* Discontinuity, the event starts a new segment */
+            if(!engine_process_triggers(e, 1))
+                return 0;
+            for(adc=0; adc < e->config.n_adcs; adc++) {
+                coinc_adc_buffer_clear(&e->buffers[adc]);
+            }
+            e->n_buffered=0;
+        }
+    }
+    if(halo && event->adc == e->config.trigger_adc) {
+        e->last_timestamp=event->timestamp;
+        return engine_process_triggers(e, 0);
+    }
+    if(!coinc_adc_buffer_push(&e->buffers[event->adc], event->timestamp, event->channel, e->event_index++)) {
+        e->failed=1;
+        return 0;
+    }
+    e->n_buffered++;
+    if(event->adc != e->config.trigger_adc && e->trigger->head == e->trigger->tail) { /* Later triggers can't be earlier than this */
+        e->n_buffered-=coinc_adc_buffer_drop_older(&e->buffers[event->adc], event->timestamp, e->config.time_window_low[event->adc]+e->delay_min);
+    }
+    e->last_timestamp=event->timestamp;
+    return engine_process_triggers(e, 0);
+}
+
+int coinc_engine_push(engine_t *e, const event *event) {
+    if(e->config.trigger_adc == ENGINE_TRIGGERLESS) {
+        if(e->stopped || e->failed)
+            return 0;
+        return engine_build_push(e, event);
+    }
+    return engine_push_event(e, event, 0);
+}
+
+int coinc_engine_push_halo(engine_t *e, const event *event) {
+    return engine_push_event(e, event, 1);
+}
+
+int coinc_engine_finish(engine_t *e) {
+    if(e->config.trigger_adc == ENGINE_TRIGGERLESS) {
+        if(!e->stopped)
+            engine_build_close(e);
+        return !e->failed;
+    }
+    if(!e->stopped && !e->failed)
+        engine_process_triggers(e, 1);
+    return !e->failed;
+}
+
+int coinc_engine_failed(const engine_t *e) {
+    return e->failed;
+}
+
+const engine_stats_t *coinc_engine_stats(const engine_t *e) {
+    return &e->stats;
+}
+
+void coinc_engine_stats_add(engine_t *e, const engine_stats_t *stats) {
+    unsigned int adc, i;
+    e->stats.n_events+=stats->n_events;
+    e->stats.n_coincidences+=stats->n_coincidences;
+    e->stats.n_truncated+=stats->n_truncated;
+    e->stats.n_out_of_order+=stats->n_out_of_order;
+    for(i=0; i < e->config.n_delays; i++) {
+        e->stats.n_delayed_coincidences[i]+=stats->n_delayed_coincidences[i];
+    }
+    for(adc=0; adc < e->config.n_adcs; adc++) {
+        e->stats.n_adc_events[adc]+=stats->n_adc_events[adc];
+        e->stats.n_delayed_adc_events[adc]+=stats->n_delayed_adc_events[adc];
+        e->stats.n_coinc_adc_events[adc]+=stats->n_coinc_adc_events[adc];
+        coinc_histogram_add(&e->stats.timediff_histogram[adc], &stats->timediff_histogram[adc]);
+    }
+}
+
+const engine_config_t *coinc_engine_config(const engine_t *e) {
+    return &e->config;
+}
+
+/* The configuration is saved field by field, without padding, to be compared when loading */
+static size_t engine_config_pack(const engine_config_t *config, unsigned char *buf) {
+    size_t n=0;
+#define ENGINE_PACK(field) memcpy(buf+n, &config->field, sizeof(config->field)); n+=sizeof(config->field)
+    ENGINE_PACK(n_adcs);
+    ENGINE_PACK(trigger_adc);
+    ENGINE_PACK(time_window_low);
+    ENGINE_PACK(time_window_high);
+    ENGINE_PACK(require);
+    ENGINE_PACK(min_multiplicity);
+    ENGINE_PACK(table_size);
+    ENGINE_PACK(n_delays);
+    ENGINE_PACK(delay);
+    ENGINE_PACK(histogram_bins);
+    ENGINE_PACK(histogram_width);
+    ENGINE_PACK(histogram_log);
+    ENGINE_PACK(build_window);
+    ENGINE_PACK(build_extending);
+#undef ENGINE_PACK
+    return n;
+}
+
+static int engine_write(FILE *f, const void *p, size_t size, size_t n) {
+    return fwrite(p, size, n, f) == n;
+}
+
+static int engine_read(FILE *f, void *p, size_t size, size_t n) {
+    return fread(p, size, n, f) == n;
+}
+
+int coinc_engine_save(const engine_t *e, FILE *f) {
+    unsigned char config[sizeof(engine_config_t)];
+    size_t config_size=engine_config_pack(&e->config, config);
+    const adc_buffer_t *buffer;
+    const histogram_t *h;
+    const coincidence_t *c=&e->coincidence;
+    unsigned int adc, n=e->config.n_adcs, slot;
+    unsigned long long int pos;
+    int ok=engine_write(f, ENGINE_STATE_MAGIC, 1, ENGINE_STATE_MAGIC_SIZE) &&
+        engine_write(f, &config_size, sizeof(config_size), 1) && engine_write(f, config, 1, config_size) &&
+        engine_write(f, &e->n_buffered, sizeof(e->n_buffered), 1) &&
+        engine_write(f, &e->event_index, sizeof(e->event_index), 1) &&
+        engine_write(f, &e->last_timestamp, sizeof(e->last_timestamp), 1) &&
+        engine_write(f, &e->truncated_timestamp, sizeof(e->truncated_timestamp), 1) &&
+        engine_write(f, &e->events_truncated, sizeof(e->events_truncated), 1) &&
+        engine_write(f, &e->table_full, sizeof(e->table_full), 1) &&
+        engine_write(f, &e->stopped, sizeof(e->stopped), 1) &&
+        engine_write(f, &e->cluster_open, sizeof(e->cluster_open), 1) &&
+        engine_write(f, &e->cluster_last, sizeof(e->cluster_last), 1) &&
+        engine_write(f, &c->trigger_timestamp, sizeof(c->trigger_timestamp), 1) &&
+        engine_write(f, c->present, sizeof(unsigned char), n) && engine_write(f, c->channel, sizeof(int), n) &&
+        engine_write(f, c->timestamp, sizeof(unsigned long long int), n) && engine_write(f, c->timediff, sizeof(long long int), n) &&
+        engine_write(f, &e->stats.n_events, sizeof(e->stats.n_events), 1) &&
+        engine_write(f, &e->stats.n_coincidences, sizeof(e->stats.n_coincidences), 1) &&
+        engine_write(f, &e->stats.n_truncated, sizeof(e->stats.n_truncated), 1) &&
+        engine_write(f, &e->stats.n_out_of_order, sizeof(e->stats.n_out_of_order), 1) &&
+        engine_write(f, e->stats.n_delayed_coincidences, sizeof(unsigned long long int), ENGINE_DELAYS_MAX) &&
+        engine_write(f, e->stats.n_adc_events, sizeof(unsigned long long int), n) &&
+        engine_write(f, e->stats.n_coinc_adc_events, sizeof(unsigned long long int), n) &&
+        engine_write(f, e->stats.n_delayed_adc_events, sizeof(unsigned long long int), n);
+    for(adc=0; ok && adc < n; adc++) {
+        h=&e->stats.timediff_histogram[adc];
+        ok=engine_write(f, &h->underflow, sizeof(h->underflow), 1) && engine_write(f, &h->overflow, sizeof(h->overflow), 1) &&
+            engine_write(f, h->counts, sizeof(unsigned long long int), h->axis.n_bins);
+        buffer=&e->buffers[adc];
+        ok=ok && engine_write(f, &buffer->head, sizeof(buffer->head), 1) && engine_write(f, &buffer->tail, sizeof(buffer->tail), 1);
+        for(pos=buffer->head; ok && pos < buffer->tail; pos++) {
+            slot=ADC_BUFFER_SLOT(buffer, pos);
+            ok=engine_write(f, &buffer->timestamp[slot], sizeof(unsigned long long int), 1) && engine_write(f, &buffer->channel[slot], sizeof(int), 1) &&
+                engine_write(f, &buffer->index[slot], sizeof(unsigned long long int), 1);
+        }
+    }
+    return ok;
+}
+
+int coinc_engine_load(engine_t *e, FILE *f) {
+    unsigned char config[sizeof(engine_config_t)], saved_config[sizeof(engine_config_t)], magic[ENGINE_STATE_MAGIC_SIZE];
+    size_t config_size=engine_config_pack(&e->config, config), saved_config_size;
+    adc_buffer_t *buffer;
+    histogram_t *h;
+    coincidence_t *c=&e->coincidence;
+    unsigned int adc, n=e->config.n_adcs;
+    unsigned long long int pos, head, tail, timestamp, index;
+    int channel;
+    int ok=engine_read(f, magic, 1, ENGINE_STATE_MAGIC_SIZE) && memcmp(magic, ENGINE_STATE_MAGIC, ENGINE_STATE_MAGIC_SIZE) == 0 &&
+        engine_read(f, &saved_config_size, sizeof(saved_config_size), 1) && saved_config_size == config_size &&
+        engine_read(f, saved_config, 1, config_size) && memcmp(saved_config, config, config_size) == 0;
+    if(!ok)
+        return 0;
+    ok=engine_read(f, &e->n_buffered, sizeof(e->n_buffered), 1) &&
+        engine_read(f, &e->event_index, sizeof(e->event_index), 1) &&
+        engine_read(f, &e->last_timestamp, sizeof(e->last_timestamp), 1) &&
+        engine_read(f, &e->truncated_timestamp, sizeof(e->truncated_timestamp), 1) &&
+        engine_read(f, &e->events_truncated, sizeof(e->events_truncated), 1) &&
+        engine_read(f, &e->table_full, sizeof(e->table_full), 1) &&
+        engine_read(f, &e->stopped, sizeof(e->stopped), 1) &&
+        engine_read(f, &e->cluster_open, sizeof(e->cluster_open), 1) &&
+        engine_read(f, &e->cluster_last, sizeof(e->cluster_last), 1) &&
+        engine_read(f, &c->trigger_timestamp, sizeof(c->trigger_timestamp), 1) &&
+        engine_read(f, c->present, sizeof(unsigned char), n) && engine_read(f, c->channel, sizeof(int), n) &&
+        engine_read(f, c->timestamp, sizeof(unsigned long long int), n) && engine_read(f, c->timediff, sizeof(long long int), n) &&
+        engine_read(f, &e->stats.n_events, sizeof(e->stats.n_events), 1) &&
+        engine_read(f, &e->stats.n_coincidences, sizeof(e->stats.n_coincidences), 1) &&
+        engine_read(f, &e->stats.n_truncated, sizeof(e->stats.n_truncated), 1) &&
+        engine_read(f, &e->stats.n_out_of_order, sizeof(e->stats.n_out_of_order), 1) &&
+        engine_read(f, e->stats.n_delayed_coincidences, sizeof(unsigned long long int), ENGINE_DELAYS_MAX) &&
+        engine_read(f, e->stats.n_adc_events, sizeof(unsigned long long int), n) &&
+        engine_read(f, e->stats.n_coinc_adc_events, sizeof(unsigned long long int), n) &&
+        engine_read(f, e->stats.n_delayed_adc_events, sizeof(unsigned long long int), n);
+    for(adc=0; ok && adc < n; adc++) {
+        h=&e->stats.timediff_histogram[adc];
+        ok=engine_read(f, &h->underflow, sizeof(h->underflow), 1) && engine_read(f, &h->overflow, sizeof(h->overflow), 1) &&
+            engine_read(f, h->counts, sizeof(unsigned long long int), h->axis.n_bins) &&
+            engine_read(f, &head, sizeof(head), 1) && engine_read(f, &tail, sizeof(tail), 1) && head <= tail;
+        buffer=&e->buffers[adc];
+        coinc_adc_buffer_clear(buffer);
+        buffer->head=buffer->tail=head; /* Positions continue where they were */
+        for(pos=head; ok && pos < tail; pos++) {
+            ok=engine_read(f, &timestamp, sizeof(timestamp), 1) && engine_read(f, &channel, sizeof(channel), 1) &&
+                engine_read(f, &index, sizeof(index), 1) && coinc_adc_buffer_push(buffer, timestamp, channel, index);
+        }
+    }
+    if(!ok)
+        e->failed=1;
+    return ok;
+}
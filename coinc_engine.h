@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_ENGINE_H
+#define COINC_ENGINE_H
+
+#include <stdio.h>
+#include "coinc_event.h"
+#include "coinc_histogram.h"
+
+#define ENGINE_TABLE_SIZE_DEFAULT 1048576
+#define ENGINE_TRIGGER_ADC_DEFAULT 0
+#define ENGINE_MIN_MULTIPLICITY_DEFAULT 2
+#define ENGINE_TRIGGERLESS (-1) /* trigger_adc for building events from all ADCs */
+#define ENGINE_DELAYS_MAX 16
+#define ENGINE_STATE_MAGIC "COINCENG"
+#define ENGINE_STATE_MAGIC_SIZE 8
+
+struct engine_config {
+    unsigned int n_adcs;
+    int trigger_adc; /* Or ENGINE_TRIGGERLESS */
+    long long int time_window_low[N_ADCS_MAX];
+    long long int time_window_high[N_ADCS_MAX];
+    int require[N_ADCS_MAX]; /* Coincidence must include this ADC */
+    int min_multiplicity;
+    unsigned int table_size; /* Maximum number of events buffered */
+    unsigned int n_delays;
+    long long int delay[ENGINE_DELAYS_MAX]; /* Delayed windows: the windows of the non-triggering ADCs shifted by this many ticks */
+    unsigned int histogram_bins; /* Time difference histograms have at most this many bins */
+    long long int histogram_width; /* Linear bins of this many ticks (widened if needed) */
+    int histogram_log; /* Logarithmic bins instead */
+    unsigned long long int build_window; /* Triggerless: events within this many ticks form an event */
+    int build_extending; /* Triggerless: the window extends from the last event of the cluster instead of the first */
+};
+
+typedef struct engine_config engine_config_t;
+
+/* Counters, updated as events are pushed. The arrays have n_adcs elements. */
+struct engine_stats {
+    unsigned long long int n_events;
+    unsigned long long int n_coincidences;
+    unsigned long long int n_truncated; /* Triggers whose windows were truncated because the table was full */
+    unsigned long long int n_out_of_order; /* Events earlier than the event before them */
+    unsigned long long int *n_adc_events;
+    unsigned long long int *n_coinc_adc_events;
+    histogram_t *timediff_histogram; /* [adc], from time_window_low[adc] to time_window_high[adc] */
+    unsigned long long int n_delayed_coincidences[ENGINE_DELAYS_MAX]; /* Accidental coincidences in each delayed window */
+    unsigned long long int *n_delayed_adc_events; /* Events in the accidental coincidences of all delayed windows */
+};
+
+typedef struct engine_stats engine_stats_t;
+
+/* Called for each coincidence found, in trigger order. c is valid only during the call, but may be modified (e.g. to
+ * fill in the monitor count). Returning 0 stops the engine. */
+typedef int (*engine_emit_function)(void *context, coincidence_t *c);
+/* Like engine_emit_function, for the coincidences of delayed window number delay_index */
+typedef int (*engine_delayed_emit_function)(void *context, unsigned int delay_index, coincidence_t *c);
+
+typedef struct engine engine_t;
+
+/* Coincidence search over a stream of events in input order. Events are buffered per ADC, and each trigger is
+ * processed as soon as an event beyond the reach of its windows has been pushed, or when the stream ends. For each
+ * other ADC the partner of a trigger is the last event in its window read before the trigger, or if there is none,
+ * the last event in its window read after the trigger.
+ *
+ * Every trigger is also searched for coincidences in the delayed windows, if there are any: the windows of the
+ * non-triggering ADCs shifted by a delay well away from the prompt peak. Coincidences found there are accidental, so
+ * they estimate the random background under the prompt peak without a second pass over the input. They are counted
+ * and passed to the delayed emit function (see coinc_engine_set_delayed_emit()), with time differences counted from the
+ * trigger timestamp plus the delay, i.e. comparable to those of the prompt coincidences. Delays are ignored without a
+ * trigger.
+ *
+ * Without a trigger (trigger_adc ENGINE_TRIGGERLESS) events are grouped into clusters in a single pass instead: a
+ * cluster starts with an event and takes every following event up to build_window ticks after its first event (fixed
+ * window) or after its latest event (extending window). The first event of each ADC in a cluster is its event for that
+ * ADC, the cluster start takes the place of the trigger timestamp and the time differences are counted from it. The
+ * multiplicity and required ADCs apply as usual. The time difference histograms cover 0..build_window, later events of
+ * extending clusters are counted as overflow. Triggerless engines can't be used with coinc_engine_push_halo(). */
+void coinc_engine_config_init(engine_config_t *config); /* Defaults, time windows zero */
+/* Widest reach of the windows of the non-triggering ADCs: partners of a trigger at t are between t+min and t+max.
+ * Input jumping back in time by more than reach is a discontinuity (e.g. timestamp reset), which ends a segment. */
+void coinc_engine_config_reach(const engine_config_t *config, long long int *min, long long int *max, long long int *reach);
+engine_t *coinc_engine_create(const engine_config_t *config, engine_emit_function emit, void *context); /* Returns NULL if memory could not be allocated */
+void coinc_engine_free(engine_t *e);
+void coinc_engine_set_delayed_emit(engine_t *e, engine_delayed_emit_function emit, void *context); /* Without one, accidental coincidences are only counted */
+int coinc_engine_push(engine_t *e, const event *event); /* event->adc must be below n_adcs. Returns 0 if the engine has stopped (see coinc_engine_failed()). */
+/* Like coinc_engine_push(), but the event is only a partner candidate for the triggers pushed with coinc_engine_push():
+ * it is not counted, and if it is from the triggering ADC it is not a trigger. For processing the input in pieces, see
+ * coinc_parallel.h. */
+int coinc_engine_push_halo(engine_t *e, const event *event);
+int coinc_engine_finish(engine_t *e); /* End of stream, processes the remaining triggers. Returns 0 if the engine failed. */
+int coinc_engine_failed(const engine_t *e); /* Non-zero if memory ran out, zero if the engine was stopped by emit or is running */
+const engine_stats_t *coinc_engine_stats(const engine_t *e);
+void coinc_engine_stats_add(engine_t *e, const engine_stats_t *stats); /* Adds the counters of another engine with the same configuration */
+const engine_config_t *coinc_engine_config(const engine_t *e);
+/* Checkpoints: coinc_engine_save() writes the whole state of the search (the buffered events, the triggers waiting for
+ * partners, the counters and the histograms) in the byte order of this computer, and coinc_engine_load() restores it
+ * into an engine created with the same configuration, which then continues with the events after the last one pushed
+ * before saving. coinc_engine_load() returns 0 if f was saved with another configuration or is not valid; if that shows
+ * only after the configuration matched, the engine is left failed. The emit functions are not part of the state. */
+int coinc_engine_save(const engine_t *e, FILE *f); /* Returns 0 if writing failed */
+int coinc_engine_load(engine_t *e, FILE *f);
+
+#endif /* COINC_ENGINE_H */
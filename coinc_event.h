@@ -0,0 +1,40 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_EVENT_H
+#define COINC_EVENT_H
+
+#define N_ADCS_MAX 128
+#define MONITORS_MAX 8
+
+struct list_event {
+    int adc;
+    int channel;
+    unsigned long long int timestamp;
+};
+
+typedef struct list_event event;
+
+/* One coincidence as it is written out. The arrays have n_adcs elements, ADCs without an event in the coincidence have
+ * present set to zero and zero channel, timestamp and timediff. */
+struct coincidence {
+    unsigned long long int trigger_timestamp;
+    long long int monitor[MONITORS_MAX]; /* Monitor counts at the trigger, if monitors are used */
+    unsigned int n_adcs;
+    unsigned char *present;
+    int *channel;
+    unsigned long long int *timestamp;
+    long long int *timediff; /* Time difference to the trigger */
+};
+
+typedef struct coincidence coincidence_t;
+
+#endif /* COINC_EVENT_H */
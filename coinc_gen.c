@@ -0,0 +1,228 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <coinc_config.h>
+#include "coinc_event.h"
+#include "coinc_binary.h"
+#include "coinc_output.h"
+#include "coinc_generator.h"
+
+#define GEN_BUFFER_EVENTS 65536
+#define GEN_RATE_DEFAULT 1000.0 /* Hz */
+#define GEN_TICK_PS_DEFAULT 1000
+#define GEN_N_EVENTS_DEFAULT 1000000
+#define TEXT_HEADER_LINE "adc channel timestamp\n"
+#define HELP_TEXT "Usage: %s [OPTION] [outfile]\n\nWrites synthetic list-mode data for testing and benchmarking coinc. The same options and seed always give the same data.\nIf no outfile is specified, standard output is used.\nValid options:\n\t--nadc=NUM\tgenerate events for NUM ADCs (default 8)\n\t--rate=HZ\trandom events per second in every ADC (default 1000)\n\t--rate=ADC,HZ\trandom events per second in ADC\n\t--tick=PS\ttimestamps count ticks of PS picoseconds (default 1000)\n\t--trigger=NUM\tADC NUM is the trigger of the true coincidences (default 0)\n\t--true-fraction=F\teach trigger event has a true partner in each other ADC with probability F (default 0)\n\t--offset=NUM\ttrue partners are NUM ticks after the trigger (default 0)\n\t--offset=ADC,NUM\ttrue partners in ADC are NUM ticks after the trigger\n\t--jitter=NUM\tstandard deviation of the time of true partners in ticks (default 0)\n\t--channels=NUM\tchannels go from 0 to NUM-1 (default 8192)\n\t--seed=NUM\tseed of the random numbers (default 1)\n\t--nevents=NUM\twrite NUM events (default 1000000)\n\t--duration=SEC\twrite SEC seconds of data instead\n\t--output-format=FMT\toutput is in format FMT, text (default) or bin (see coinc_binary.h)\n\n"
+
+static int write_text(generator_t *g, FILE *f, unsigned long long n_events, unsigned long long end) {
+    output_t *out=output_open(f);
+    unsigned long long i;
+    event event;
+    if(!out)
+        return 0;
+    output_string(out, TEXT_HEADER_LINE);
+    for(i=0; !n_events || i < n_events; i++) {
+        if(!generator_next(g, &event)) {
+            output_close(out);
+            return 0;
+        }
+        if(end && event.timestamp >= end)
+            break;
+        output_int(out, event.adc, 0);
+        output_char(out, ' ');
+        output_int(out, event.channel, 0);
+        output_char(out, ' ');
+        output_uint(out, event.timestamp, 0);
+        output_char(out, '\n');
+    }
+    return output_close(out);
+}
+
+static int write_binary(generator_t *g, FILE *f, binary_header_t *header, unsigned long long n_events, unsigned long long end) {
+    unsigned char *buffer=malloc(GEN_BUFFER_EVENTS*BINARY_RECORD_SIZE);
+    size_t n=0;
+    unsigned long long i;
+    event event;
+    int ok;
+    header->n_events=n_events;
+    if(!buffer || !binary_header_write(header, f)) {
+        free(buffer);
+        return 0;
+    }
+    for(i=0; !n_events || i < n_events; i++) {
+        if(!generator_next(g, &event)) {
+            free(buffer);
+            return 0;
+        }
+        if(end && event.timestamp >= end)
+            break;
+        binary_record_encode(buffer+n*BINARY_RECORD_SIZE, &event);
+        if(++n == GEN_BUFFER_EVENTS) {
+            if(fwrite(buffer, BINARY_RECORD_SIZE, n, f) != n) {
+                free(buffer);
+                return 0;
+            }
+            n=0;
+        }
+    }
+    ok=(fwrite(buffer, BINARY_RECORD_SIZE, n, f) == n);
+    free(buffer);
+    if(ok && !n_events) { /* Fill in the number of events if the output is seekable */
+        header->n_events=i;
+        if(fseek(f, 0, SEEK_SET) == 0)
+            ok=binary_header_write(header, f);
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int i, adc;
+    generator_config_t config;
+    generator_t *g;
+    binary_header_t header;
+    double rate[N_ADCS_MAX], value;
+    long long int offset;
+    unsigned long long tick_ps=GEN_TICK_PS_DEFAULT, n_events=GEN_N_EVENTS_DEFAULT, end=0;
+    double duration=0.0;
+    int binary=0, ok;
+    char *output_filename=NULL;
+    FILE *out=stdout;
+
+    generator_config_init(&config);
+    for(adc=0; adc < N_ADCS_MAX; adc++) {
+        rate[adc]=GEN_RATE_DEFAULT;
+    }
+    if(argc == 1) {
+        fprintf(stderr, "coinc-gen %s\n", coinc_VERSION);
+        fprintf(stderr, HELP_TEXT, argv[0]);
+        return 0;
+    }
+    for(i=1; i < argc; i++) {
+        if(sscanf(argv[i], "--nadc=%u", &config.n_adcs) == 1) {
+            if(config.n_adcs < 1 || config.n_adcs > N_ADCS_MAX) {
+                fprintf(stderr, "Number of ADCs must be from 1 to %i.\n", N_ADCS_MAX);
+                return 0;
+            }
+            continue;
+        }
+        if(sscanf(argv[i], "--rate=%i,%lf", &adc, &value) == 2) {
+            if(adc < 0 || adc >= N_ADCS_MAX || value < 0.0) {
+                fprintf(stderr, "Invalid rate \"%s\".\n", argv[i]);
+                return 0;
+            }
+            rate[adc]=value;
+            continue;
+        }
+        if(sscanf(argv[i], "--rate=%lf", &value) == 1) {
+            for(adc=0; adc < N_ADCS_MAX; adc++) {
+                rate[adc]=value;
+            }
+            continue;
+        }
+        if(sscanf(argv[i], "--tick=%llu", &tick_ps) == 1) {
+            continue;
+        }
+        if(sscanf(argv[i], "--trigger=%i", &config.trigger_adc) == 1) {
+            continue;
+        }
+        if(sscanf(argv[i], "--true-fraction=%lf", &config.true_fraction) == 1) {
+            continue;
+        }
+        if(sscanf(argv[i], "--offset=%i,%lli", &adc, &offset) == 2) {
+            if(adc < 0 || adc >= N_ADCS_MAX) {
+                fprintf(stderr, "Invalid ADC in \"%s\".\n", argv[i]);
+                return 0;
+            }
+            config.offset[adc]=offset;
+            continue;
+        }
+        if(sscanf(argv[i], "--offset=%lli", &offset) == 1) {
+            for(adc=0; adc < N_ADCS_MAX; adc++) {
+                config.offset[adc]=offset;
+            }
+            continue;
+        }
+        if(sscanf(argv[i], "--jitter=%lf", &config.jitter) == 1) {
+            continue;
+        }
+        if(sscanf(argv[i], "--channels=%i", &config.channels) == 1) {
+            continue;
+        }
+        if(sscanf(argv[i], "--seed=%llu", &config.seed) == 1) {
+            continue;
+        }
+        if(sscanf(argv[i], "--nevents=%llu", &n_events) == 1) {
+            continue;
+        }
+        if(sscanf(argv[i], "--duration=%lf", &duration) == 1) {
+            n_events=0;
+            continue;
+        }
+        if(strcmp(argv[i], "--output-format=text") == 0) {
+            binary=0;
+            continue;
+        }
+        if(strcmp(argv[i], "--output-format=bin") == 0) {
+            binary=1;
+            continue;
+        }
+        if(strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Unrecognized option \"%s\"\n", argv[i]);
+            return 0;
+        }
+        output_filename=argv[i];
+    }
+    if(config.trigger_adc < 0 || (unsigned int)config.trigger_adc >= config.n_adcs) {
+        fprintf(stderr, "Trigger ADC must be below the number of ADCs.\n");
+        return 0;
+    }
+    if(!tick_ps) {
+        fprintf(stderr, "A tick must be at least one picosecond.\n");
+        return 0;
+    }
+    for(adc=0; adc < N_ADCS_MAX; adc++) {
+        config.rate[adc]=rate[adc]*tick_ps*1e-12;
+    }
+    if(duration > 0.0)
+        end=config.start+(unsigned long long)(duration*1e12/tick_ps);
+    g=generator_create(&config);
+    if(!g) {
+        fprintf(stderr, "Could not create the generator, check that some ADC has a rate and there is at least one channel.\n");
+        return 0;
+    }
+    if(output_filename && strcmp(output_filename, "-") != 0) {
+        out=fopen(output_filename, binary?"wb":"w");
+        if(!out) {
+            fprintf(stderr, "Could not open file \"%s\" for output.\n", output_filename);
+            generator_free(g);
+            return 0;
+        }
+    }
+    if(binary) {
+        binary_header_init(&header);
+        header.n_adcs=config.n_adcs;
+        header.tick_ps=tick_ps;
+        ok=write_binary(g, out, &header, n_events, end);
+    } else {
+        ok=write_text(g, out, n_events, end);
+    }
+    generator_free(g);
+    if(out != stdout && fclose(out) != 0)
+        ok=0;
+    if(!ok) {
+        fprintf(stderr, "Error writing output.\n");
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,181 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "coinc_generator.h"
+
+#define GENERATOR_HEAP_SIZE_INITIAL 1024
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Events are generated ahead into a binary heap on the timestamp and come out when no event generated later can be
+ * earlier than them: true partners may be up to horizon ticks before their trigger. */
+struct generator {
+    generator_config_t config;
+    unsigned long long int state; /* splitmix64 */
+    double next_time[N_ADCS_MAX]; /* Of the next random event of each ADC */
+    double horizon;
+    event *heap;
+    size_t heap_size, n_heap;
+};
+
+void generator_config_init(generator_config_t *config) {
+    memset(config, 0, sizeof(generator_config_t));
+    config->n_adcs=8;
+    config->channels=8192;
+    config->seed=1;
+}
+
+static unsigned long long int generator_random(generator_t *g) {
+    unsigned long long int z=(g->state+=0x9e3779b97f4a7c15ULL);
+    z=(z^(z >> 30))*0xbf58476d1ce4e5b9ULL;
+    z=(z^(z >> 27))*0x94d049bb133111ebULL;
+    return z^(z >> 31);
+}
+
+static double generator_uniform(generator_t *g) { /* [0, 1) */
+    return (double)(generator_random(g) >> 11)*(1.0/9007199254740992.0);
+}
+
+static double generator_gaussian(generator_t *g) {
+    double u=1.0-generator_uniform(g), v=generator_uniform(g), x;
+    x=sqrt(-2.0*log(u))*cos(2.0*M_PI*v);
+    if(x > GENERATOR_JITTER_CUTOFF)
+        return GENERATOR_JITTER_CUTOFF;
+    if(x < -GENERATOR_JITTER_CUTOFF)
+        return -GENERATOR_JITTER_CUTOFF;
+    return x;
+}
+
+static double generator_interval(generator_t *g, unsigned int adc) {
+    return -log(1.0-generator_uniform(g))/g->config.rate[adc];
+}
+
+static int generator_heap_push(generator_t *g, int adc, unsigned long long int timestamp) {
+    event *heap;
+    size_t i, parent;
+    if(g->n_heap == g->heap_size) {
+        heap=realloc(g->heap, 2*g->heap_size*sizeof(event));
+        if(!heap)
+            return 0;
+        g->heap=heap;
+        g->heap_size*=2;
+    }
+    for(i=g->n_heap++; i > 0; i=parent) {
+        parent=(i-1)/2;
+        if(g->heap[parent].timestamp <= timestamp)
+            break;
+        g->heap[i]=g->heap[parent];
+    }
+    g->heap[i].adc=adc;
+    g->heap[i].channel=(int)(generator_random(g)%(unsigned long long int)g->config.channels);
+    g->heap[i].timestamp=timestamp;
+    return 1;
+}
+
+static void generator_heap_pop(generator_t *g, event *event) {
+    size_t i=0, child;
+    const struct list_event *last=&g->heap[--g->n_heap];
+    *event=g->heap[0];
+    while((child=2*i+1) < g->n_heap) {
+        if(child+1 < g->n_heap && g->heap[child+1].timestamp < g->heap[child].timestamp)
+            child++;
+        if(last->timestamp <= g->heap[child].timestamp)
+            break;
+        g->heap[i]=g->heap[child];
+        i=child;
+    }
+    g->heap[i]=*last;
+}
+
+generator_t *generator_create(const generator_config_t *config) {
+    generator_t *g;
+    unsigned int adc, n_sources=0;
+    double offset;
+    if(config->n_adcs > N_ADCS_MAX || config->channels < 1)
+        return NULL;
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if(config->rate[adc] > 0.0)
+            n_sources++;
+    }
+    if(!n_sources)
+        return NULL;
+    g=calloc(1, sizeof(generator_t));
+    if(!g)
+        return NULL;
+    g->config=*config;
+    g->state=config->seed;
+    g->heap_size=GENERATOR_HEAP_SIZE_INITIAL;
+    g->heap=malloc(g->heap_size*sizeof(event));
+    if(!g->heap) {
+        free(g);
+        return NULL;
+    }
+    for(adc=0; adc < config->n_adcs; adc++) {
+        g->next_time[adc]=(config->rate[adc] > 0.0)?(double)config->start+generator_interval(g, adc):HUGE_VAL;
+        offset=(double)(config->offset[adc] < 0?-config->offset[adc]:config->offset[adc]);
+        if(offset+GENERATOR_JITTER_CUTOFF*config->jitter+1.0 > g->horizon)
+            g->horizon=offset+GENERATOR_JITTER_CUTOFF*config->jitter+1.0;
+    }
+    return g;
+}
+
+void generator_free(generator_t *g) {
+    if(!g)
+        return;
+    free(g->heap);
+    free(g);
+}
+
+/* Generates the next random event and its true partners */
+static int generator_step(generator_t *g) {
+    unsigned int adc, source=0, partner;
+    double t, partner_time;
+    for(adc=1; adc < g->config.n_adcs; adc++) {
+        if(g->next_time[adc] < g->next_time[source])
+            source=adc;
+    }
+    t=g->next_time[source];
+    g->next_time[source]+=generator_interval(g, source);
+    if(!generator_heap_push(g, (int)source, (unsigned long long int)t))
+        return 0;
+    if((int)source != g->config.trigger_adc)
+        return 1;
+    for(partner=0; partner < g->config.n_adcs; partner++) {
+        if(partner == source || generator_uniform(g) >= g->config.true_fraction)
+            continue;
+        partner_time=t+(double)g->config.offset[partner]+g->config.jitter*generator_gaussian(g);
+        if(partner_time >= 0.0 && !generator_heap_push(g, (int)partner, (unsigned long long int)partner_time))
+            return 0;
+    }
+    return 1;
+}
+
+int generator_next(generator_t *g, event *event) {
+    double earliest;
+    unsigned int adc;
+    while(1) {
+        earliest=HUGE_VAL;
+        for(adc=0; adc < g->config.n_adcs; adc++) {
+            if(g->next_time[adc] < earliest)
+                earliest=g->next_time[adc];
+        }
+        if(g->n_heap && (double)g->heap[0].timestamp+g->horizon < earliest) {
+            generator_heap_pop(g, event);
+            return 1;
+        }
+        if(!generator_step(g))
+            return 0;
+    }
+}
@@ -0,0 +1,45 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_GENERATOR_H
+#define COINC_GENERATOR_H
+
+#include "coinc_event.h"
+
+#define GENERATOR_JITTER_CUTOFF 5.0 /* Jitter is cut off at this many standard deviations */
+
+/* Synthetic list-mode data for testing and benchmarking (coinc-gen, coinc-bench). Every ADC has random events at its
+ * own rate. Each event of the trigger ADC is a true coincidence with each other ADC with probability true_fraction:
+ * that ADC then also has an event offset[adc] ticks after the trigger, with Gaussian jitter. Channels are uniformly
+ * distributed. The stream is in time order and endless, and the same seed always gives the same stream on every
+ * computer. */
+struct generator_config {
+    unsigned int n_adcs;
+    int trigger_adc;
+    double rate[N_ADCS_MAX]; /* Random events per tick */
+    double true_fraction;
+    long long int offset[N_ADCS_MAX];
+    double jitter; /* Standard deviation of the time of true partners, ticks */
+    int channels;
+    unsigned long long int start; /* Timestamp of the beginning of the stream */
+    unsigned long long int seed;
+};
+
+typedef struct generator_config generator_config_t;
+
+typedef struct generator generator_t;
+
+void generator_config_init(generator_config_t *config); /* 8 ADCs, no events */
+generator_t *generator_create(const generator_config_t *config); /* Returns NULL if no ADC has events or memory could not be allocated */
+int generator_next(generator_t *g, event *event); /* Returns 0 if memory ran out */
+void generator_free(generator_t *g);
+
+#endif /* COINC_GENERATOR_H */
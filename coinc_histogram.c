@@ -0,0 +1,148 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include "coinc_histogram.h"
+
+static unsigned int highest_bit(unsigned long long int x) {
+    unsigned int bit=0;
+    while(x >>= 1)
+        bit++;
+    return bit;
+}
+
+/* Logarithmic bin of distance d from the origin with k=2^shift bins per doubling */
+static unsigned long long int histogram_log_bin(unsigned long long int d, unsigned int shift) {
+    unsigned int e;
+    if(d < (2ULL << shift))
+        return d;
+    e=highest_bit(d)-shift;
+    return ((unsigned long long int)e << shift)+(d >> e);
+}
+
+/* Smallest distance in logarithmic bin */
+static unsigned long long int histogram_log_edge(unsigned long long int bin, unsigned int shift) {
+    unsigned int e;
+    if(bin < (2ULL << shift))
+        return bin;
+    e=(unsigned int)(bin >> shift)-1;
+    return (bin-((unsigned long long int)e << shift)) << e;
+}
+
+int coinc_histogram_axis_init(histogram_axis_t *axis, long long int low, long long int high, long long int width, int log, unsigned int n_bins_max) {
+    unsigned long long int span, n_below=0, n_bins=0;
+    unsigned int shift;
+    if(high < low || !n_bins_max)
+        return 0;
+    span=(unsigned long long int)high-(unsigned long long int)low; /* Number of values minus one */
+    axis->low=low;
+    axis->high=high;
+    axis->width=1;
+    axis->log_k=0;
+    axis->log_shift=0;
+    axis->origin=(low > 0)?low:((high < 0)?high:0);
+    axis->n_below=0;
+    if(log) {
+        for(shift=62; ; shift--) {
+            n_below=(axis->origin > low)?histogram_log_bin((unsigned long long int)axis->origin-(unsigned long long int)low-1, shift)+1:0;
+            n_bins=n_below+histogram_log_bin((unsigned long long int)high-(unsigned long long int)axis->origin, shift)+1;
+            if(n_bins <= n_bins_max || shift == 0)
+                break;
+        }
+        if(n_bins > n_bins_max)
+            return 0;
+        if(n_bins-1 < span) { /* Otherwise every value has a bin of its own, which is just linear */
+            axis->log_k=1U << shift;
+            axis->log_shift=shift;
+            axis->n_below=(unsigned int)n_below;
+            axis->n_bins=(unsigned int)n_bins;
+            return 1;
+        }
+    }
+    if(width < 1)
+        width=1;
+    if(span/(unsigned long long int)width+1 > n_bins_max)
+        width=(long long int)(span/n_bins_max+1);
+    axis->width=width;
+    axis->n_bins=(unsigned int)(span/(unsigned long long int)width+1);
+    return 1;
+}
+
+long long int coinc_histogram_axis_bin(const histogram_axis_t *axis, long long int value) {
+    if(value < axis->low)
+        return -1;
+    if(value > axis->high)
+        return axis->n_bins;
+    if(!axis->log_k)
+        return (long long int)(((unsigned long long int)value-(unsigned long long int)axis->low)/(unsigned long long int)axis->width);
+    if(value >= axis->origin)
+        return axis->n_below+(long long int)histogram_log_bin((unsigned long long int)value-(unsigned long long int)axis->origin, axis->log_shift);
+    return axis->n_below-1-(long long int)histogram_log_bin((unsigned long long int)axis->origin-(unsigned long long int)value-1, axis->log_shift);
+}
+
+long long int coinc_histogram_axis_edge(const histogram_axis_t *axis, unsigned int bin) {
+    if(!axis->log_k)
+        return axis->low+(long long int)bin*axis->width;
+    if(bin >= axis->n_below)
+        return (long long int)((unsigned long long int)axis->origin+histogram_log_edge(bin-axis->n_below, axis->log_shift));
+    if(bin == 0) /* The bin reaching furthest below the origin may be cut short */
+        return axis->low;
+    return (long long int)((unsigned long long int)axis->origin-histogram_log_edge(axis->n_below-bin, axis->log_shift));
+}
+
+int coinc_histogram_init(histogram_t *h, const histogram_axis_t *axis) {
+    h->axis=*axis;
+    h->underflow=0;
+    h->overflow=0;
+    h->counts=calloc(axis->n_bins, sizeof(unsigned long long int));
+    return h->counts != NULL;
+}
+
+void coinc_histogram_free(histogram_t *h) {
+    free(h->counts);
+    h->counts=NULL;
+}
+
+void coinc_histogram_fill(histogram_t *h, long long int value) {
+    long long int bin=coinc_histogram_axis_bin(&h->axis, value);
+    if(bin < 0) {
+        h->underflow++;
+    } else if(bin >= h->axis.n_bins) {
+        h->overflow++;
+    } else {
+        h->counts[bin]++;
+    }
+}
+
+void coinc_histogram_add(histogram_t *h, const histogram_t *other) {
+    unsigned int bin;
+    for(bin=0; bin < h->axis.n_bins; bin++) {
+        h->counts[bin]+=other->counts[bin];
+    }
+    h->underflow+=other->underflow;
+    h->overflow+=other->overflow;
+}
+
+long long int coinc_histogram_percentile(const histogram_t *h, double fraction) {
+    unsigned long long int total=h->underflow+h->overflow, stop, integral;
+    unsigned int bin;
+    for(bin=0; bin < h->axis.n_bins; bin++) {
+        total+=h->counts[bin];
+    }
+    stop=(unsigned long long int)(fraction*total);
+    integral=h->underflow;
+    for(bin=0; bin < h->axis.n_bins; bin++) {
+        integral+=h->counts[bin];
+        if(integral >= stop)
+            return coinc_histogram_axis_edge(&h->axis, bin);
+    }
+    return coinc_histogram_axis_edge(&h->axis, h->axis.n_bins-1);
+}
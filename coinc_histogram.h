@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_HISTOGRAM_H
+#define COINC_HISTOGRAM_H
+
+#define HISTOGRAM_BINS_DEFAULT 65536
+
+/* Binning of integer values from low to high (inclusive) into at most a given number of bins, so that memory does not
+ * depend on the range. Linear bins are width values wide; the width is increased if the range would not fit otherwise.
+ * Logarithmic bins get wider with the distance from zero (or from the end of the range nearest to it), on both sides:
+ * the 2*k values nearest to zero on each side have a bin each, and after that every doubling of the distance is split
+ * into k bins, k being the largest power of two that fits. Time differences thus keep their resolution at the prompt
+ * peak however wide the window. */
+struct histogram_axis {
+    long long int low, high;
+    long long int width; /* Linear bins */
+    unsigned int log_k; /* Logarithmic bins: k, 0 for linear bins */
+    unsigned int log_shift; /* k=2^log_shift */
+    long long int origin; /* Logarithmic bins: zero, or low or high if zero is not in the range */
+    unsigned int n_below; /* Logarithmic bins: bins below origin */
+    unsigned int n_bins;
+};
+
+typedef struct histogram_axis histogram_axis_t;
+
+/* Returns 0 if the range is empty or log is set and the range needs more than n_bins_max bins even with k=1 */
+int coinc_histogram_axis_init(histogram_axis_t *axis, long long int low, long long int high, long long int width, int log, unsigned int n_bins_max);
+long long int coinc_histogram_axis_bin(const histogram_axis_t *axis, long long int value); /* -1 below low, n_bins above high */
+long long int coinc_histogram_axis_edge(const histogram_axis_t *axis, unsigned int bin); /* Lowest value in the bin */
+
+/* Counts of values on one axis. Values outside the range are counted separately. */
+struct histogram {
+    histogram_axis_t axis;
+    unsigned long long int *counts;
+    unsigned long long int underflow, overflow;
+};
+
+typedef struct histogram histogram_t;
+
+int coinc_histogram_init(histogram_t *h, const histogram_axis_t *axis); /* Returns 0 if memory could not be allocated */
+void coinc_histogram_free(histogram_t *h);
+void coinc_histogram_fill(histogram_t *h, long long int value);
+void coinc_histogram_add(histogram_t *h, const histogram_t *other); /* Adds the counts of a histogram with the same axis */
+/* The lowest value of the first bin where the cumulative count reaches fraction of the total. Values outside the range
+ * count as the first or last bin. */
+long long int coinc_histogram_percentile(const histogram_t *h, double fraction);
+
+#endif /* COINC_HISTOGRAM_H */
@@ -0,0 +1,190 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "coinc_index.h"
+
+#define INDEX_SIZE_INITIAL 1024 /* Entries */
+
+struct input_index {
+    unsigned long long data_begin;
+    unsigned long long stride;
+    unsigned long long n_events; /* Added so far */
+    unsigned long long *timestamp;
+    unsigned long long *offset;
+    unsigned long long n_entries, size;
+};
+
+input_index_t *index_create(unsigned long long data_begin, unsigned long long stride) {
+    input_index_t *idx=calloc(1, sizeof(input_index_t));
+    if(!idx)
+        return NULL;
+    idx->data_begin=data_begin;
+    idx->stride=stride?stride:1;
+    return idx;
+}
+
+void index_free(input_index_t *idx) {
+    if(!idx)
+        return;
+    free(idx->timestamp);
+    free(idx->offset);
+    free(idx);
+}
+
+static int index_reserve(input_index_t *idx, unsigned long long size) {
+    unsigned long long *p;
+    if(size <= idx->size)
+        return 1;
+    if(size > ((size_t)-1)/sizeof(unsigned long long))
+        return 0;
+    if(!(p=realloc(idx->timestamp, size*sizeof(unsigned long long))))
+        return 0;
+    idx->timestamp=p;
+    if(!(p=realloc(idx->offset, size*sizeof(unsigned long long))))
+        return 0;
+    idx->offset=p;
+    idx->size=size;
+    return 1;
+}
+
+int index_add(input_index_t *idx, unsigned long long offset, unsigned long long timestamp) {
+    if(idx->n_events++%idx->stride)
+        return 1;
+    if(idx->n_entries == idx->size && !index_reserve(idx, idx->size?2*idx->size:INDEX_SIZE_INITIAL))
+        return 0;
+    idx->timestamp[idx->n_entries]=timestamp;
+    idx->offset[idx->n_entries]=offset;
+    idx->n_entries++;
+    return 1;
+}
+
+input_index_t *index_build(const char *filename, input_format format) {
+    input_t *in=input_open_quiet(filename, format);
+    input_index_t *idx=NULL;
+    unsigned long long offset;
+    event event;
+    int ok=1;
+    if(!in)
+        return NULL;
+    if(input_seekable(in) && (input_binary_header(in) || input_skip(in, 1)))
+        idx=index_create(input_offset(in), INDEX_STRIDE_DEFAULT);
+    while(idx && ok) {
+        offset=input_offset(in);
+        if(!input_read_event(in, &event))
+            break;
+        ok=index_add(idx, offset, event.timestamp);
+    }
+    input_close(in);
+    if(!ok) {
+        index_free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+unsigned long long index_find(const input_index_t *idx, unsigned long long timestamp, unsigned long long *found_timestamp) {
+    unsigned long long low=0, high=idx->n_entries, mid;
+    while(low < high) { /* First entry at or after timestamp */
+        mid=low+(high-low)/2;
+        if(idx->timestamp[mid] < timestamp) {
+            low=mid+1;
+        } else {
+            high=mid;
+        }
+    }
+    *found_timestamp=low?idx->timestamp[low-1]:0;
+    return low?idx->offset[low-1]:idx->data_begin;
+}
+
+char *index_filename(const char *input_filename) {
+    size_t len=strlen(input_filename);
+    char *filename=malloc(len+sizeof(INDEX_SUFFIX));
+    if(!filename)
+        return NULL;
+    memcpy(filename, input_filename, len);
+    memcpy(filename+len, INDEX_SUFFIX, sizeof(INDEX_SUFFIX));
+    return filename;
+}
+
+int index_write(const input_index_t *idx, const char *filename, unsigned long long input_size) {
+    FILE *f=fopen(filename, "wb");
+    unsigned char buf[INDEX_HEADER_SIZE];
+    unsigned long long i;
+    int ok;
+    if(!f)
+        return 0;
+    memset(buf, 0, INDEX_HEADER_SIZE);
+    memcpy(buf, INDEX_MAGIC, INDEX_MAGIC_SIZE);
+    binary_put_u32(buf+8, INDEX_VERSION);
+    binary_put_u32(buf+12, INDEX_HEADER_SIZE);
+    binary_put_u64(buf+16, input_size);
+    binary_put_u64(buf+24, idx->data_begin);
+    binary_put_u64(buf+32, idx->stride);
+    binary_put_u64(buf+40, idx->n_entries);
+    ok=(fwrite(buf, 1, INDEX_HEADER_SIZE, f) == INDEX_HEADER_SIZE);
+    for(i=0; ok && i < idx->n_entries; i++) {
+        binary_put_u64(buf, idx->timestamp[i]);
+        binary_put_u64(buf+8, idx->offset[i]);
+        ok=(fwrite(buf, 1, INDEX_ENTRY_SIZE, f) == INDEX_ENTRY_SIZE);
+    }
+    ok=(fclose(f) == 0) && ok;
+    if(!ok)
+        remove(filename);
+    return ok;
+}
+
+input_index_t *index_read(const char *filename, unsigned long long input_size) {
+    FILE *f=fopen(filename, "rb");
+    unsigned char buf[INDEX_HEADER_SIZE];
+    input_index_t *idx=NULL;
+    unsigned long long n_entries=0, header_size=0, i;
+    long file_size=-1;
+    int ok;
+    if(!f)
+        return NULL;
+    ok=(fread(buf, 1, INDEX_HEADER_SIZE, f) == INDEX_HEADER_SIZE &&
+        memcmp(buf, INDEX_MAGIC, INDEX_MAGIC_SIZE) == 0 &&
+        binary_get_u32(buf+8) == INDEX_VERSION &&
+        binary_get_u32(buf+12) >= INDEX_HEADER_SIZE &&
+        binary_get_u64(buf+16) == input_size &&
+        binary_get_u64(buf+24) <= input_size &&
+        fseek(f, 0, SEEK_END) == 0 && (file_size=ftell(f)) >= 0);
+    if(ok) { /* The entries must fill the rest of the file exactly */
+        header_size=binary_get_u32(buf+12);
+        n_entries=binary_get_u64(buf+40);
+        ok=((unsigned long long)file_size >= header_size &&
+            ((unsigned long long)file_size-header_size)%INDEX_ENTRY_SIZE == 0 &&
+            ((unsigned long long)file_size-header_size)/INDEX_ENTRY_SIZE == n_entries &&
+            fseek(f, (long)header_size, SEEK_SET) == 0);
+    }
+    if(ok) {
+        idx=index_create(binary_get_u64(buf+24), binary_get_u64(buf+32));
+        ok=idx && index_reserve(idx, n_entries);
+    }
+    for(i=0; ok && i < n_entries; i++) {
+        ok=(fread(buf, 1, INDEX_ENTRY_SIZE, f) == INDEX_ENTRY_SIZE && binary_get_u64(buf+8) <= input_size);
+        if(!ok)
+            break;
+        idx->timestamp[i]=binary_get_u64(buf);
+        idx->offset[i]=binary_get_u64(buf+8);
+        idx->n_entries++;
+    }
+    fclose(f);
+    if(!ok) {
+        index_free(idx);
+        return NULL;
+    }
+    idx->n_events=n_entries*idx->stride;
+    return idx;
+}
@@ -0,0 +1,67 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_INDEX_H
+#define COINC_INDEX_H
+
+#include "coinc_input.h"
+
+/* Sparse timestamp index of a time-ordered input file, kept next to it with INDEX_SUFFIX appended to its name, for
+ * starting at a given time (coinc --from-time) without reading everything before it. It has the timestamp and offset of
+ * every stride-th event. All integers are little-endian.
+ *
+ * Header (INDEX_HEADER_SIZE bytes):
+ *   offset  size  field
+ *        0     8  magic "COINCIDX"
+ *        8     4  format version (INDEX_VERSION)
+ *       12     4  header size in bytes, entries start at this offset
+ *       16     8  size of the indexed input (input_size()), a different size means the index is stale (the event at the
+ *                 offset found must also have the indexed timestamp, see index_find())
+ *       24     8  offset of the first event
+ *       32     8  events from one entry to the next
+ *       40     8  number of entries
+ *       48    16  reserved, must be zero
+ *
+ * Entry (INDEX_ENTRY_SIZE bytes), the first for the first event:
+ *   offset  size  field
+ *        0     8  timestamp of the event (unsigned)
+ *        8     8  offset of the event in the input */
+
+#define INDEX_MAGIC "COINCIDX"
+#define INDEX_MAGIC_SIZE 8
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 64
+#define INDEX_ENTRY_SIZE 16
+#define INDEX_SUFFIX ".cidx"
+#define INDEX_STRIDE_DEFAULT 65536
+
+typedef struct input_index input_index_t;
+
+input_index_t *index_create(unsigned long long data_begin, unsigned long long stride); /* Returns NULL if memory could not be allocated */
+void index_free(input_index_t *idx);
+/* Call with the offset and timestamp of every event from the first one on, in input order. Returns 0 if memory could
+ * not be allocated. */
+int index_add(input_index_t *idx, unsigned long long offset, unsigned long long timestamp);
+/* Indexes a memory-mappable input file from after its header (the first line of text input) to the end or the first
+ * malformed event. Returns NULL if the file could not be read or memory allocated. */
+input_index_t *index_build(const char *filename, input_format format);
+/* Where to start reading for the events from timestamp on: the offset of the last indexed event earlier than it, or of
+ * the first event if there is none. The timestamp of the indexed event is stored in found_timestamp (0 if there is
+ * none), for checking that the input has not been rewritten with the same size since it was indexed. */
+unsigned long long index_find(const input_index_t *idx, unsigned long long timestamp, unsigned long long *found_timestamp);
+
+char *index_filename(const char *input_filename); /* The file name of the index of the input (allocated) */
+int index_write(const input_index_t *idx, const char *filename, unsigned long long input_size); /* Returns 0 on failure */
+/* Returns NULL if the index is missing, stale (for input of another size), truncated or otherwise not valid, e.g. with
+ * offsets past the end of the input */
+input_index_t *index_read(const char *filename, unsigned long long input_size);
+
+#endif /* COINC_INDEX_H */
@@ -0,0 +1,629 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <coinc_config.h>
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_POLL
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#include <stddef.h>
+#include "coinc_input.h"
+
+struct input {
+    FILE *f;
+    input_format format;
+    binary_header_t header; /* Only for INPUT_FORMAT_BINARY */
+    char *data; /* Memory-mapped file or read buffer */
+    size_t data_size; /* Size of the mapping or allocated size of the read buffer */
+    const char *cur; /* Parsing continues from here */
+    const char *end; /* End of complete lines (or records) in data, parsing never goes beyond this */
+    const char *data_end; /* End of valid data, the bytes between end and data_end are an incomplete line (or record) */
+    int mapped;
+    int quiet; /* No messages */
+    int eof; /* Nothing more can be read from f */
+    int follow; /* The end of a regular file is not the end of input, see input_open_follow() */
+    int regular; /* f is a regular file */
+    int error;
+    unsigned long long line; /* Line number at cur */
+    unsigned long long event_line; /* Line number of the event returned last */
+    int line_unknown; /* Text input was read from the middle (input_seek()), messages give byte offsets instead of lines */
+    const char *event_start; /* Event returned last, for messages when the line number is unknown */
+};
+
+typedef enum PARSE_RESULT_E {
+    PARSE_OK = 0,
+    PARSE_END = 1, /* Nothing but whitespace before end of data */
+    PARSE_INCOMPLETE = 2, /* Data ended in the middle of an event */
+    PARSE_ERROR = 3
+} parse_result;
+
+static void input_message(const input_t *in, const char *format, ...) {
+    va_list args;
+    if(in->quiet)
+        return;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static int is_space(char c) {
+    return (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f');
+}
+
+static const char *skip_space(const char *p, const char *end, unsigned long long *lines) {
+    while(p < end && is_space(*p)) {
+        if(*p == '\n')
+            (*lines)++;
+        p++;
+    }
+    return p;
+}
+
+static int hex_digit(char c) {
+    if(c >= '0' && c <= '9')
+        return c-'0';
+    if(c >= 'a' && c <= 'f')
+        return c-'a'+10;
+    if(c >= 'A' && c <= 'F')
+        return c-'A'+10;
+    return -1;
+}
+
+/* Parses an integer the way scanf %i does: decimal, octal with a leading 0 or hexadecimal with a leading 0x. Returns
+ * NULL if there are no digits. */
+static const char *parse_i(const char *p, const char *end, int *out) {
+    unsigned long long v=0;
+    int negative=0, d;
+    const char *start;
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative=(*p == '-');
+        p++;
+    }
+    start=p;
+    if(p < end && *p == '0') {
+        p++;
+        if(p+1 < end && (*p == 'x' || *p == 'X') && hex_digit(p[1]) >= 0) {
+            p++;
+            while(p < end && (d=hex_digit(*p)) >= 0) {
+                v=v*16+d;
+                p++;
+            }
+        } else {
+            while(p < end && *p >= '0' && *p <= '7') {
+                v=v*8+(*p-'0');
+                p++;
+            }
+        }
+    } else {
+        while(p < end && (unsigned char)(*p-'0') < 10) {
+            v=v*10+(*p-'0');
+            p++;
+        }
+    }
+    if(p == start)
+        return NULL;
+    *out=(int)(negative?-v:v);
+    return p;
+}
+
+/* Parses an unsigned decimal integer like scanf %llu */
+static const char *parse_llu(const char *p, const char *end, unsigned long long *out) {
+    unsigned long long v=0;
+    int negative=0;
+    const char *start;
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative=(*p == '-');
+        p++;
+    }
+    start=p;
+    while(p < end && (unsigned char)(*p-'0') < 10) {
+        v=v*10+(*p-'0');
+        p++;
+    }
+    if(p == start)
+        return NULL;
+    *out=negative?-v:v;
+    return p;
+}
+
+/* Fields never straddle end, since end is either the end of a complete line or the end of the input. Running out of
+ * data between fields means the event continues on a line that has not been read yet. */
+static parse_result parse_event(const char **pp, const char *end, event *event, unsigned long long *lines, const char **start) {
+    const char *p=*pp;
+    p=skip_space(p, end, lines);
+    *pp=p;
+    *start=p;
+    if(p == end)
+        return PARSE_END;
+    if(!(p=parse_i(p, end, &event->adc)))
+        return PARSE_ERROR;
+    p=skip_space(p, end, lines);
+    if(p == end)
+        return PARSE_INCOMPLETE;
+    if(!(p=parse_i(p, end, &event->channel)))
+        return PARSE_ERROR;
+    p=skip_space(p, end, lines);
+    if(p == end)
+        return PARSE_INCOMPLETE;
+    if(!(p=parse_llu(p, end, &event->timestamp)))
+        return PARSE_ERROR;
+    *pp=p;
+    return PARSE_OK;
+}
+
+static int input_decode_header(input_t *in, size_t size) {
+    switch(binary_header_decode(&in->header, (const unsigned char *)in->data, size)) {
+        case BINARY_HEADER_OK:
+            return 1;
+        case BINARY_HEADER_NOT_BINARY:
+            input_message(in, "Input is not in the binary list-mode format.\n");
+            break;
+        case BINARY_HEADER_UNSUPPORTED:
+            input_message(in, "Binary list-mode format version %u is not supported (expected %i).\n", in->header.version, BINARY_VERSION);
+            break;
+        case BINARY_HEADER_CORRUPTED:
+            input_message(in, "Binary list-mode header is corrupted (header size %u, record size %u).\n", in->header.header_size, in->header.record_size);
+            break;
+    }
+    return 0;
+}
+
+/* Reads the binary header from the beginning of data, reading more if necessary */
+static int input_read_header(input_t *in) {
+    size_t n_read;
+    if(in->mapped) {
+        if(!input_decode_header(in, in->data_size))
+            return 0;
+        if(in->header.header_size > in->data_size) {
+            input_message(in, "Binary list-mode input is truncated.\n");
+            return 0;
+        }
+        in->cur=in->data+in->header.header_size;
+        in->end=in->cur+(in->data_size-in->header.header_size)/in->header.record_size*in->header.record_size;
+        in->data_end=in->data+in->data_size;
+    } else {
+        n_read=fread(in->data, 1, BINARY_HEADER_SIZE, in->f);
+        if(!input_decode_header(in, n_read))
+            return 0;
+        n_read=in->header.header_size-BINARY_HEADER_SIZE; /* Skip the part of the header we don't understand */
+        while(n_read--) {
+            if(fgetc(in->f) == EOF) {
+                input_message(in, "Binary list-mode input is truncated.\n");
+                return 0;
+            }
+        }
+    }
+    if(in->mapped && (in->data_size-in->header.header_size)%in->header.record_size) {
+        input_message(in, "Warning: binary list-mode input ends with a truncated record, which is ignored.\n");
+    }
+    if(in->header.n_events && in->mapped && (unsigned long long)(in->end-in->cur)/in->header.record_size != in->header.n_events) {
+        input_message(in, "Warning: binary header says there are %llu events, but the file contains %llu.\n",
+                (unsigned long long)in->header.n_events, (unsigned long long)(in->end-in->cur)/in->header.record_size);
+    }
+    return 1;
+}
+
+static input_t *input_open_messages(const char *filename, input_format format, int quiet, int follow) {
+    input_t *in=calloc(1, sizeof(input_t));
+#if defined(HAVE_MMAP) || defined(HAVE_POLL)
+    struct stat st;
+#endif
+    if(!in)
+        return NULL;
+    in->format=format;
+    in->quiet=quiet;
+    in->follow=follow;
+    if(!filename || strcmp(filename, "-") == 0) {
+        in->f=stdin;
+    } else {
+        in->f=fopen(filename, format == INPUT_FORMAT_BINARY?"rb":"r");
+        if(!in->f) {
+            free(in);
+            return NULL;
+        }
+    }
+    in->line=1;
+#ifdef HAVE_POLL
+    in->regular=(fstat(fileno(in->f), &st) == 0 && S_ISREG(st.st_mode));
+#endif
+#ifdef HAVE_MMAP
+    if(!follow && fstat(fileno(in->f), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        in->data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in->f), 0);
+        if(in->data != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(in->data, st.st_size, MADV_SEQUENTIAL);
+#endif
+            in->mapped=1;
+            in->eof=1;
+            in->data_size=st.st_size;
+            in->cur=in->data;
+            in->end=in->data+in->data_size;
+            in->data_end=in->end;
+            if(format == INPUT_FORMAT_BINARY && !input_read_header(in)) {
+                input_close(in);
+                return NULL;
+            }
+            return in;
+        }
+        in->data=NULL;
+    }
+#endif
+    in->data_size=INPUT_BUFFER_SIZE;
+    in->data=malloc(in->data_size);
+    if(!in->data) {
+        input_close(in);
+        return NULL;
+    }
+    setvbuf(in->f, NULL, _IONBF, 0); /* We do our own buffering */
+    if(format == INPUT_FORMAT_BINARY && !input_read_header(in)) {
+        input_close(in);
+        return NULL;
+    }
+    in->cur=in->data;
+    in->end=in->data;
+    in->data_end=in->data;
+    return in;
+}
+
+input_t *input_open(const char *filename, input_format format) {
+    return input_open_messages(filename, format, 0, 0);
+}
+
+input_t *input_open_quiet(const char *filename, input_format format) {
+    return input_open_messages(filename, format, 1, 0);
+}
+
+int input_follow_available(void) {
+#ifdef HAVE_POLL
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+input_t *input_open_follow(const char *filename, input_format format) {
+#ifdef HAVE_POLL
+    return input_open_messages(filename, format, 0, 1);
+#else
+    (void)filename;
+    (void)format;
+    return NULL;
+#endif
+}
+
+void input_close(input_t *in) {
+    if(!in)
+        return;
+#ifdef HAVE_MMAP
+    if(in->mapped) {
+        munmap(in->data, in->data_size);
+        in->data=NULL;
+    }
+#endif
+    free(in->data);
+    if(in->f && in->f != stdin)
+        fclose(in->f);
+    free(in);
+}
+
+/* Sets end to the end of the last complete line or record after cur. Returns 0 if there is none. */
+static int input_find_end(input_t *in) {
+    const char *p;
+    if(in->format == INPUT_FORMAT_BINARY) {
+        in->end=in->cur+(in->data_end-in->cur)/in->header.record_size*in->header.record_size;
+        return (in->end > in->cur);
+    }
+    for(p=in->data_end; p > in->cur && p[-1] != '\n'; p--) {}
+    in->end=p;
+    return (p > in->cur);
+}
+
+/* Reads into the buffer after the first remaining bytes. When following, only what is available now is read and eof is
+ * set only at the end of a pipe. */
+static size_t input_read_some(input_t *in, size_t remaining) {
+#ifdef HAVE_POLL
+    struct pollfd pfd;
+    ssize_t n_read;
+    if(in->follow) {
+        pfd.fd=fileno(in->f);
+        pfd.events=POLLIN;
+        if(!in->regular && poll(&pfd, 1, 0) < 1)
+            return 0;
+        n_read=read(pfd.fd, in->data+remaining, in->data_size-remaining);
+        if(n_read < 0 && errno != EINTR && errno != EAGAIN)
+            in->eof=1;
+        if(n_read == 0 && !in->regular)
+            in->eof=1;
+        return n_read > 0?(size_t)n_read:0;
+    }
+#endif
+    return fread(in->data+remaining, 1, in->data_size-remaining, in->f);
+}
+
+/* Reads more data into the buffer, keeping the unparsed data. Afterwards end points to just after the last newline
+ * (or complete record) in the buffer, or to the end of data if the input has ended. Returns 0 if no new data could be
+ * read. */
+static int input_fill(input_t *in) {
+    size_t remaining, n_read;
+    char *new_data;
+    if(in->eof)
+        return 0;
+    remaining=in->data_end-in->cur;
+    memmove(in->data, in->cur, remaining);
+    in->cur=in->data;
+    in->data_end=in->data+remaining;
+    while(1) {
+        if(remaining == in->data_size) { /* A line longer than the buffer */
+            new_data=realloc(in->data, in->data_size*2);
+            if(!new_data) {
+                input_message(in, "\nCould not allocate memory for input buffer.\n");
+                in->error=1;
+                in->eof=1;
+                return 0;
+            }
+            in->data=new_data;
+            in->data_size*=2;
+            in->cur=in->data;
+            in->data_end=in->data+remaining;
+        }
+        n_read=input_read_some(in, remaining);
+        if(n_read == 0 && in->follow && !in->eof) { /* Nothing more for now */
+            input_find_end(in);
+            return 0;
+        }
+        if(n_read == 0) {
+            in->eof=1;
+            in->end=in->data_end;
+            return (remaining > 0);
+        }
+        remaining+=n_read;
+        in->data_end=in->data+remaining;
+        if(input_find_end(in))
+            return 1;
+    }
+}
+
+/* Like input_fill(), but when following waits until there is new data or the input ends */
+static int input_fill_wait(input_t *in) {
+    while(!input_fill(in)) {
+        if(!input_waiting(in))
+            return 0;
+        input_wait(in, INPUT_FOLLOW_POLL_MS);
+    }
+    return 1;
+}
+
+int input_waiting(const input_t *in) {
+    return in->follow && !in->eof && !in->error;
+}
+
+void input_wait(input_t *in, unsigned int timeout_ms) {
+#ifdef HAVE_POLL
+    struct pollfd pfd;
+    struct timespec t;
+    if(!in->regular) {
+        pfd.fd=fileno(in->f);
+        pfd.events=POLLIN;
+        poll(&pfd, 1, (int)timeout_ms);
+        return;
+    }
+    if(timeout_ms > INPUT_FOLLOW_POLL_MS)
+        timeout_ms=INPUT_FOLLOW_POLL_MS;
+    t.tv_sec=timeout_ms/1000;
+    t.tv_nsec=(long)(timeout_ms%1000)*1000000L;
+    nanosleep(&t, NULL);
+#else
+    (void)in;
+    (void)timeout_ms;
+#endif
+}
+
+/* Describes where p is for messages: "on line N", or "at byte offset N" if the line number is not known */
+static const char *input_describe(const input_t *in, unsigned long long line, const char *p, char *buf, size_t size) {
+    if(in->line_unknown) {
+        snprintf(buf, size, "at byte offset %llu", (unsigned long long)(p-in->data));
+    } else {
+        snprintf(buf, size, "on line %llu", line);
+    }
+    return buf;
+}
+
+static int input_read_binary_event(input_t *in, event *event) {
+    if(in->cur == in->end && !input_fill(in)) {
+        return 0;
+    }
+    if(in->end-in->cur < (ptrdiff_t)in->header.record_size && in->follow && !in->eof) {
+        return 0; /* Not yet */
+    }
+    if(in->end-in->cur < (ptrdiff_t)in->header.record_size) { /* Only possible at the end of input */
+        input_message(in, "\nBinary list-mode input ends with a truncated record.\n");
+        in->error=1;
+        return 0;
+    }
+    binary_record_decode((const unsigned char *)in->cur, event);
+    in->cur+=in->header.record_size;
+    in->event_line++;
+    return 1;
+}
+
+int input_read_event(input_t *in, event *event) {
+    const char *p, *start;
+    unsigned long long lines;
+    parse_result result;
+    char position[64];
+    if(in->error)
+        return 0;
+    if(in->format == INPUT_FORMAT_BINARY)
+        return input_read_binary_event(in, event);
+    while(1) {
+        p=in->cur;
+        lines=0;
+        result=parse_event(&p, in->end, event, &lines, &start);
+        if(result == PARSE_OK) {
+            in->event_line=in->line+lines;
+            in->event_start=start;
+            in->cur=p;
+            in->line+=lines;
+            return 1;
+        }
+        if(result == PARSE_END) { /* Whitespace can be consumed regardless */
+            in->cur=p;
+            in->line+=lines;
+        }
+        if(result != PARSE_ERROR && input_fill(in)) {
+            continue;
+        }
+        if(result != PARSE_ERROR && in->follow && !in->eof) {
+            return 0; /* Not yet */
+        }
+        if(result == PARSE_INCOMPLETE) {
+            input_message(in, "\nIncomplete event at the end of input %s.\n", input_describe(in, in->line+lines, start, position, sizeof(position)));
+            in->error=1;
+        } else if(result == PARSE_ERROR) {
+            input_message(in, "\nError in input data %s.\n", input_describe(in, in->line+lines, start, position, sizeof(position)));
+            in->error=1;
+        }
+        return 0;
+    }
+}
+
+static int input_skip_binary_events(input_t *in, unsigned long long n) {
+    unsigned long long available;
+    while(n) {
+        if(in->cur == in->end && !input_fill_wait(in)) {
+            return 0;
+        }
+        available=(in->end-in->cur)/in->header.record_size;
+        if(!available) {
+            return 0;
+        }
+        if(available > n) {
+            available=n;
+        }
+        in->cur+=available*in->header.record_size;
+        in->event_line+=available;
+        n-=available;
+    }
+    return 1;
+}
+
+int input_skip(input_t *in, unsigned long long n) {
+    const char *newline;
+    if(in->format == INPUT_FORMAT_BINARY)
+        return input_skip_binary_events(in, n);
+    while(n) {
+        if(in->cur == in->end && !input_fill_wait(in)) {
+            return 0;
+        }
+        newline=memchr(in->cur, '\n', in->end-in->cur);
+        if(newline) {
+            in->cur=newline+1;
+            in->line++;
+        } else { /* Last line of input without a newline */
+            in->cur=in->end;
+        }
+        n--;
+    }
+    return 1;
+}
+
+int input_read_adc_event(input_t *in, event *event, int n_adcs) {
+    char position[64];
+    if(!input_read_event(in, event))
+        return 0;
+    if(event->adc < n_adcs && event->adc >= 0)
+        return 1;
+    input_message(in, "ADC value %i %s too high or negative, aborting. Check input file or try increasing number of ADCs (currently %i).\n",
+            event->adc, input_describe(in, in->event_line, in->event_start, position, sizeof(position)), n_adcs);
+    in->error=1;
+    return 0;
+}
+
+const char *input_position(const input_t *in, char *buf, size_t size) {
+    return input_describe(in, in->event_line, in->event_start, buf, size);
+}
+
+unsigned long long input_line(const input_t *in) {
+    return in->event_line;
+}
+
+int input_seekable(const input_t *in) {
+    return in->mapped;
+}
+
+unsigned long long input_offset(const input_t *in) {
+    return in->cur-in->data;
+}
+
+unsigned long long input_size(const input_t *in) {
+    return in->end-in->data;
+}
+
+unsigned long long input_seek(input_t *in, unsigned long long offset) {
+    const char *p, *newline;
+    unsigned long long record_size;
+    if(!in->mapped)
+        return input_offset(in);
+    if(offset > input_size(in))
+        offset=input_size(in);
+    if(in->format == INPUT_FORMAT_BINARY) {
+        record_size=in->header.record_size;
+        if(offset < in->header.header_size)
+            offset=in->header.header_size;
+        offset=in->header.header_size+(offset-in->header.header_size+record_size-1)/record_size*record_size;
+        in->cur=in->data+offset;
+        in->event_line=(offset-in->header.header_size)/record_size;
+    } else {
+        p=in->data+offset;
+        if(p > in->data && p[-1] != '\n') {
+            newline=memchr(p, '\n', in->end-p);
+            p=newline?newline+1:in->end;
+        }
+        in->cur=p;
+        in->line_unknown=(p > in->data);
+        in->line=1;
+    }
+    in->error=0;
+    return input_offset(in);
+}
+
+unsigned long long input_seek_line(input_t *in, unsigned long long offset) {
+    const char *p;
+    unsigned long long lines=1;
+    offset=input_seek(in, offset);
+    if(in->mapped && in->format == INPUT_FORMAT_TEXT) {
+        for(p=in->data; (p=memchr(p, '\n', in->cur-p)) != NULL; p++) {
+            lines++;
+        }
+        in->line=lines;
+        in->line_unknown=0;
+    }
+    return offset;
+}
+
+int input_error(const input_t *in) {
+    return in->error;
+}
+
+const binary_header_t *input_binary_header(const input_t *in) {
+    return in->format == INPUT_FORMAT_BINARY?&in->header:NULL;
+}
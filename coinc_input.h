@@ -0,0 +1,61 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_INPUT_H
+#define COINC_INPUT_H
+
+#include <stddef.h>
+#include "coinc_event.h"
+#include "coinc_binary.h"
+
+#define INPUT_BUFFER_SIZE (1<<20) /* Bytes read at a time from pipes and stdin */
+#define INPUT_FOLLOW_POLL_MS 50 /* A followed regular file is checked for new data this often */
+
+typedef enum INPUT_FORMAT_E {
+    INPUT_FORMAT_TEXT = 0,
+    INPUT_FORMAT_BINARY = 1
+} input_format;
+
+/* List-mode input. Regular files are memory-mapped when possible, everything else (pipes, stdin) is read in large
+ * blocks. In text format events are whitespace separated "adc channel timestamp" triples, parsed like
+ * fscanf("%i %i %llu\n") would, but without going through stdio for every line. The binary format is described in
+ * coinc_binary.h. */
+typedef struct input input_t;
+
+input_t *input_open(const char *filename, input_format format); /* filename NULL or "-" reads standard input. Returns NULL on failure. */
+input_t *input_open_quiet(const char *filename, input_format format); /* Like input_open(), but no messages are printed */
+void input_close(input_t *in);
+int input_read_event(input_t *in, event *event); /* Returns 1 on success, 0 at end of input or on error */
+int input_read_adc_event(input_t *in, event *event, int n_adcs); /* Like input_read_event(), but an ADC outside 0..n_adcs-1 is an error */
+int input_skip(input_t *in, unsigned long long n); /* Skips n lines (text) or events (binary, O(1) for files). Returns 0 if input ran out first. */
+unsigned long long input_line(const input_t *in); /* Line number (text) or record number (binary) of the event read last */
+const char *input_position(const input_t *in, char *buf, size_t size); /* "on line N" (or "at byte offset N") of the event read last, for messages */
+int input_error(const input_t *in); /* Non-zero if reading stopped because of malformed input */
+
+/* Following input that is still being written (e.g. coinc --follow). A regular file is not mapped but read as it grows,
+ * its end is never the end of input. A pipe ends when the writer closes it. Reading an event does not block: if a
+ * complete event has not arrived yet, input_read_event() returns 0 and input_waiting() is non-zero. Skipping lines (or
+ * events) waits for them. Needs poll(), see input_follow_available(). */
+int input_follow_available(void);
+input_t *input_open_follow(const char *filename, input_format format); /* Like input_open() */
+int input_waiting(const input_t *in); /* Non-zero if input is followed and has not ended */
+void input_wait(input_t *in, unsigned int timeout_ms); /* Waits at most timeout_ms for more data */
+const binary_header_t *input_binary_header(const input_t *in); /* NULL for text input */
+
+/* Random access, only for memory-mapped input (input_seekable() non-zero). Offsets are in bytes from the beginning of
+ * the file. After seeking in text input line numbers are not known, so messages give byte offsets instead. */
+int input_seekable(const input_t *in);
+unsigned long long input_offset(const input_t *in); /* Where the next event is read from */
+unsigned long long input_size(const input_t *in); /* End of the last complete line or record */
+unsigned long long input_seek(input_t *in, unsigned long long offset); /* Continues from the first line (or record) starting at or after offset. Returns its offset. */
+unsigned long long input_seek_line(input_t *in, unsigned long long offset); /* Like input_seek(), but counts the lines before offset to keep line numbers known */
+
+#endif /* COINC_INPUT_H */
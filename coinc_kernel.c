@@ -0,0 +1,136 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include "coinc_kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static uint64_t window_mask_scalar(const unsigned long long int *timestamp, unsigned int n, unsigned long long int trigger_timestamp, long long int low, long long int high) {
+    uint64_t mask=0;
+    long long int time_difference;
+    unsigned int i;
+    for(i=0; i < n; i++) {
+        time_difference=timestamp[i]-trigger_timestamp;
+        mask|=(uint64_t)(time_difference >= low && time_difference <= high) << i;
+    }
+    return mask;
+}
+
+static int supported_always(void) {
+    return 1;
+}
+
+#ifdef HAVE_X86_KERNELS
+/* The vector kernels compute the differences with wrapping 64-bit subtraction and compare them as signed numbers,
+ * exactly like the scalar kernel. The tail that does not fill a whole vector is done with the scalar kernel. */
+
+__attribute__((target("sse4.2")))
+static uint64_t window_mask_sse42(const unsigned long long int *timestamp, unsigned int n, unsigned long long int trigger_timestamp, long long int low, long long int high) {
+    const __m128i t=_mm_set1_epi64x((long long int)trigger_timestamp);
+    const __m128i l=_mm_set1_epi64x(low);
+    const __m128i h=_mm_set1_epi64x(high);
+    __m128i d, outside;
+    uint64_t mask=0;
+    unsigned int i;
+    for(i=0; i+2 <= n; i+=2) {
+        d=_mm_sub_epi64(_mm_loadu_si128((const __m128i *)(timestamp+i)), t);
+        outside=_mm_or_si128(_mm_cmpgt_epi64(l, d), _mm_cmpgt_epi64(d, h));
+        mask|=(uint64_t)(~_mm_movemask_pd(_mm_castsi128_pd(outside)) & 0x3) << i;
+    }
+    if(i < n)
+        mask|=window_mask_scalar(timestamp+i, n-i, trigger_timestamp, low, high) << i;
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t window_mask_avx2(const unsigned long long int *timestamp, unsigned int n, unsigned long long int trigger_timestamp, long long int low, long long int high) {
+    const __m256i t=_mm256_set1_epi64x((long long int)trigger_timestamp);
+    const __m256i l=_mm256_set1_epi64x(low);
+    const __m256i h=_mm256_set1_epi64x(high);
+    __m256i d, outside;
+    uint64_t mask=0;
+    unsigned int i;
+    for(i=0; i+4 <= n; i+=4) {
+        d=_mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(timestamp+i)), t);
+        outside=_mm256_or_si256(_mm256_cmpgt_epi64(l, d), _mm256_cmpgt_epi64(d, h));
+        mask|=(uint64_t)(~_mm256_movemask_pd(_mm256_castsi256_pd(outside)) & 0xF) << i;
+    }
+    if(i < n)
+        mask|=window_mask_scalar(timestamp+i, n-i, trigger_timestamp, low, high) << i;
+    return mask;
+}
+
+__attribute__((target("avx512f")))
+static uint64_t window_mask_avx512(const unsigned long long int *timestamp, unsigned int n, unsigned long long int trigger_timestamp, long long int low, long long int high) {
+    const __m512i t=_mm512_set1_epi64((long long int)trigger_timestamp);
+    const __m512i l=_mm512_set1_epi64(low);
+    const __m512i h=_mm512_set1_epi64(high);
+    __m512i d;
+    uint64_t mask=0;
+    unsigned int i;
+    for(i=0; i+8 <= n; i+=8) {
+        d=_mm512_sub_epi64(_mm512_loadu_si512((const void *)(timestamp+i)), t);
+        mask|=(uint64_t)(_mm512_cmpge_epi64_mask(d, l) & _mm512_cmple_epi64_mask(d, h)) << i;
+    }
+    if(i < n) { /* Masked load, no need for the scalar tail */
+        d=_mm512_sub_epi64(_mm512_maskz_loadu_epi64((__mmask8)((1u << (n-i))-1), (const void *)(timestamp+i)), t);
+        mask|=(uint64_t)(_mm512_cmpge_epi64_mask(d, l) & _mm512_cmple_epi64_mask(d, h) & (__mmask8)((1u << (n-i))-1)) << i;
+    }
+    return mask;
+}
+
+static int supported_sse42(void) {
+    return __builtin_cpu_supports("sse4.2");
+}
+
+static int supported_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+static int supported_avx512(void) {
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+const window_kernel_t coinc_window_kernels[]={
+#ifdef HAVE_X86_KERNELS
+    {"avx512", window_mask_avx512, supported_avx512},
+    {"avx2", window_mask_avx2, supported_avx2},
+    {"sse4.2", window_mask_sse42, supported_sse42},
+#endif
+    {"scalar", window_mask_scalar, supported_always},
+    {NULL, NULL, NULL}
+};
+
+window_mask_function coinc_window_mask=window_mask_scalar;
+static int kernel_selected=0;
+
+const window_kernel_t *coinc_kernel_select(const char *name) {
+    const window_kernel_t *kernel;
+    for(kernel=coinc_window_kernels; kernel->name; kernel++) {
+        if((!name || strcmp(name, kernel->name) == 0) && kernel->supported()) {
+            coinc_window_mask=kernel->window_mask;
+            kernel_selected=1;
+            return kernel;
+        }
+    }
+    return NULL;
+}
+
+void coinc_kernel_select_default(void) {
+    if(!kernel_selected)
+        coinc_kernel_select(NULL);
+}
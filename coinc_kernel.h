@@ -0,0 +1,37 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_KERNEL_H
+#define COINC_KERNEL_H
+
+#include <stdint.h>
+
+#define KERNEL_BLOCK_SIZE 64 /* Maximum number of timestamps tested in one call, one bit each in the mask */
+
+/* Tests n (at most KERNEL_BLOCK_SIZE) timestamps against a time window. Bit i of the returned mask is set if the time
+ * difference timestamp[i]-trigger_timestamp, taken as a signed 64-bit number, is from low to high inclusive. */
+typedef uint64_t (*window_mask_function)(const unsigned long long int *timestamp, unsigned int n, unsigned long long int trigger_timestamp, long long int low, long long int high);
+
+struct window_kernel {
+    const char *name;
+    window_mask_function window_mask;
+    int (*supported)(void); /* Non-zero if the CPU can run this kernel */
+};
+
+typedef struct window_kernel window_kernel_t;
+
+extern const window_kernel_t coinc_window_kernels[]; /* All kernels compiled in, best first, terminated by a NULL name */
+extern window_mask_function coinc_window_mask; /* Selected kernel, the scalar one until coinc_kernel_select() or coinc_kernel_select_default() is called */
+
+const window_kernel_t *coinc_kernel_select(const char *name); /* Selects the named kernel, or the best supported one if name is NULL. Returns NULL if the named kernel is not available. */
+void coinc_kernel_select_default(void); /* Selects the best supported kernel, unless coinc_kernel_select() has already selected one */
+
+#endif /* COINC_KERNEL_H */
@@ -0,0 +1,107 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+/* Microbenchmark of the window search kernels. For each buffer size, every kernel tests all events of a buffer
+ * against the window of a set of triggers. The masks are checked against the scalar kernel, and the program fails
+ * (returns 0, like the other tools) if any of them differs. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "coinc_kernel.h"
+
+#define N_TRIGGERS 64
+#define EVENTS_PER_SIZE 50000000ULL /* Approximate number of window tests per kernel and buffer size */
+
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static uint64_t run(window_mask_function kernel, const unsigned long long int *timestamp, unsigned int size, const unsigned long long int *triggers, long long int low, long long int high, unsigned long long int repeats) {
+    uint64_t checksum=0;
+    unsigned long long int r;
+    unsigned int t, i, n;
+    for(r=0; r < repeats; r++) {
+        for(t=0; t < N_TRIGGERS; t++) {
+            for(i=0; i < size; i+=n) {
+                n=size-i < KERNEL_BLOCK_SIZE?size-i:KERNEL_BLOCK_SIZE;
+                checksum+=kernel(timestamp+i, n, triggers[t], low, high)*(i+1);
+            }
+        }
+    }
+    return checksum;
+}
+
+static int same_masks(window_mask_function kernel, window_mask_function reference, const unsigned long long int *timestamp, unsigned int size, const unsigned long long int *triggers, long long int low, long long int high) {
+    unsigned int t, i, n;
+    for(t=0; t < N_TRIGGERS; t++) {
+        for(i=0; i < size; i+=n) {
+            n=size-i < KERNEL_BLOCK_SIZE?size-i:KERNEL_BLOCK_SIZE;
+            if(kernel(timestamp+i, n, triggers[t], low, high) != reference(timestamp+i, n, triggers[t], low, high))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    static const unsigned int sizes[]={20, 64, 256, 1024, 4096, 0};
+    unsigned long long int *timestamp, triggers[N_TRIGGERS], repeats;
+    const window_kernel_t *kernel, *scalar;
+    unsigned int s, i, size;
+    double t0, t1, scalar_time=0;
+    long long int low, high;
+    int same, ok=1;
+    (void)argc;
+    (void)argv;
+    srand(1);
+    printf("%6s %-8s %12s %8s\n", "size", "kernel", "ns/event", "speedup");
+    for(s=0; sizes[s]; s++) {
+        size=sizes[s];
+        timestamp=malloc(size*sizeof(unsigned long long int));
+        if(!timestamp) {
+            fprintf(stderr, "Could not allocate memory.\n");
+            return 0;
+        }
+        timestamp[0]=1000000;
+        for(i=1; i < size; i++) {
+            timestamp[i]=timestamp[i-1]+rand()%8;
+        }
+        for(i=0; i < N_TRIGGERS; i++) {
+            triggers[i]=timestamp[rand()%size];
+        }
+        low=-(long long int)(timestamp[size-1]-timestamp[0])/8; /* About a quarter of the buffer is in the window */
+        high=-low;
+        repeats=EVENTS_PER_SIZE/size/N_TRIGGERS+1;
+        for(scalar=coinc_window_kernels; scalar[1].name; scalar++); /* The scalar kernel is the last one and the reference */
+        t0=now();
+        run(scalar->window_mask, timestamp, size, triggers, low, high, repeats);
+        scalar_time=now()-t0;
+        for(kernel=coinc_window_kernels; kernel->name; kernel++) {
+            if(!kernel->supported()) {
+                printf("%6u %-8s %12s\n", size, kernel->name, "unsupported");
+                continue;
+            }
+            same=same_masks(kernel->window_mask, scalar->window_mask, timestamp, size, triggers, low, high);
+            t0=now();
+            run(kernel->window_mask, timestamp, size, triggers, low, high, repeats);
+            t1=now();
+            printf("%6u %-8s %12.3f %7.2fx%s\n", size, kernel->name, (t1-t0)*1e9/(repeats*N_TRIGGERS*size), scalar_time/(t1-t0), same?"":"  MISMATCH");
+            ok=ok && same;
+        }
+        free(timestamp);
+    }
+    if(!ok)
+        fprintf(stderr, "The masks of a kernel differ from those of the scalar kernel.\n");
+    return ok;
+}
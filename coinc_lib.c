@@ -0,0 +1,203 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <coinc_config.h>
+#include "coinc_lib.h"
+#include "coinc_kernel.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+static pthread_once_t kernel_once=PTHREAD_ONCE_INIT;
+#endif
+
+#define COINC_QUEUE_SIZE_INITIAL 1024 /* Coincidences */
+
+/* Queued coincidences, row after row, n_adcs elements per row in the per-ADC arrays */
+struct coinc_queue {
+    size_t size, n, head; /* Rows allocated, rows queued, next row to pull */
+    unsigned long long int *trigger_timestamp;
+    unsigned char *present;
+    int *channel;
+    unsigned long long int *timestamp;
+    long long int *timediff;
+};
+
+struct coinc {
+    engine_t *engine;
+    engine_emit_function emit; /* NULL to queue */
+    void *context;
+    struct coinc_queue queue;
+    coincidence_t current; /* Points to the row pulled last */
+    int queue_failed;
+};
+
+static int coinc_queue_grow(struct coinc_queue *q, unsigned int n_adcs) {
+    size_t size=q->size?2*q->size:COINC_QUEUE_SIZE_INITIAL;
+    void *p;
+    if(!(p=realloc(q->trigger_timestamp, size*sizeof(unsigned long long int))))
+        return 0;
+    q->trigger_timestamp=p;
+    if(!(p=realloc(q->present, size*n_adcs*sizeof(unsigned char))))
+        return 0;
+    q->present=p;
+    if(!(p=realloc(q->channel, size*n_adcs*sizeof(int))))
+        return 0;
+    q->channel=p;
+    if(!(p=realloc(q->timestamp, size*n_adcs*sizeof(unsigned long long int))))
+        return 0;
+    q->timestamp=p;
+    if(!(p=realloc(q->timediff, size*n_adcs*sizeof(long long int))))
+        return 0;
+    q->timediff=p;
+    q->size=size;
+    return 1;
+}
+
+/* Moves the rows not pulled yet to the beginning */
+static void coinc_queue_compact(struct coinc_queue *q, unsigned int n_adcs) {
+    size_t n=q->n-q->head, offset=q->head*n_adcs;
+    if(!q->head)
+        return;
+    memmove(q->trigger_timestamp, q->trigger_timestamp+q->head, n*sizeof(unsigned long long int));
+    memmove(q->present, q->present+offset, n*n_adcs*sizeof(unsigned char));
+    memmove(q->channel, q->channel+offset, n*n_adcs*sizeof(int));
+    memmove(q->timestamp, q->timestamp+offset, n*n_adcs*sizeof(unsigned long long int));
+    memmove(q->timediff, q->timediff+offset, n*n_adcs*sizeof(long long int));
+    q->n=n;
+    q->head=0;
+}
+
+static int coinc_emit(void *context, coincidence_t *c) {
+    coinc_t *search=context;
+    struct coinc_queue *q=&search->queue;
+    size_t offset;
+    if(search->emit)
+        return search->emit(search->context, c);
+    if(q->n == q->size && !coinc_queue_grow(q, c->n_adcs)) {
+        search->queue_failed=1;
+        return 0;
+    }
+    offset=q->n*c->n_adcs;
+    q->trigger_timestamp[q->n]=c->trigger_timestamp;
+    memcpy(q->present+offset, c->present, c->n_adcs*sizeof(unsigned char));
+    memcpy(q->channel+offset, c->channel, c->n_adcs*sizeof(int));
+    memcpy(q->timestamp+offset, c->timestamp, c->n_adcs*sizeof(unsigned long long int));
+    memcpy(q->timediff+offset, c->timediff, c->n_adcs*sizeof(long long int));
+    q->n++;
+    return 1;
+}
+
+coinc_t *coinc_create(const engine_config_t *config) {
+    coinc_t *search;
+#ifdef HAVE_PTHREAD
+    pthread_once(&kernel_once, coinc_kernel_select_default);
+#else
+    coinc_kernel_select_default();
+#endif
+    search=calloc(1, sizeof(coinc_t));
+    if(!search)
+        return NULL;
+    search->engine=coinc_engine_create(config, coinc_emit, search);
+    if(!search->engine) {
+        free(search);
+        return NULL;
+    }
+    search->current.n_adcs=config->n_adcs;
+    return search;
+}
+
+void coinc_free(coinc_t *search) {
+    if(!search)
+        return;
+    coinc_engine_free(search->engine);
+    free(search->queue.trigger_timestamp);
+    free(search->queue.present);
+    free(search->queue.channel);
+    free(search->queue.timestamp);
+    free(search->queue.timediff);
+    free(search);
+}
+
+void coinc_set_callback(coinc_t *search, engine_emit_function emit, void *context) {
+    search->emit=emit;
+    search->context=context;
+}
+
+void coinc_set_delayed_callback(coinc_t *search, engine_delayed_emit_function emit, void *context) {
+    coinc_engine_set_delayed_emit(search->engine, emit, context);
+}
+
+size_t coinc_push(coinc_t *search, const event *events, size_t n) {
+    size_t i;
+    coinc_queue_compact(&search->queue, search->current.n_adcs);
+    for(i=0; i < n; i++) {
+        if(!coinc_engine_push(search->engine, &events[i]))
+            break;
+    }
+    return i;
+}
+
+size_t coinc_push_halo(coinc_t *search, const event *events, size_t n) {
+    size_t i;
+    coinc_queue_compact(&search->queue, search->current.n_adcs);
+    for(i=0; i < n; i++) {
+        if(!coinc_engine_push_halo(search->engine, &events[i]))
+            break;
+    }
+    return i;
+}
+
+int coinc_finish(coinc_t *search) {
+    coinc_queue_compact(&search->queue, search->current.n_adcs);
+    return coinc_engine_finish(search->engine) && !search->queue_failed;
+}
+
+int coinc_failed(const coinc_t *search) {
+    return coinc_engine_failed(search->engine) || search->queue_failed;
+}
+
+const coincidence_t *coinc_next(coinc_t *search) {
+    struct coinc_queue *q=&search->queue;
+    coincidence_t *c=&search->current;
+    size_t offset=q->head*c->n_adcs;
+    if(q->head == q->n)
+        return NULL;
+    c->trigger_timestamp=q->trigger_timestamp[q->head];
+    memset(c->monitor, 0, sizeof(c->monitor));
+    c->present=q->present+offset;
+    c->channel=q->channel+offset;
+    c->timestamp=q->timestamp+offset;
+    c->timediff=q->timediff+offset;
+    q->head++;
+    return c;
+}
+
+int coinc_save(const coinc_t *search, FILE *f) {
+    return coinc_engine_save(search->engine, f);
+}
+
+int coinc_load(coinc_t *search, FILE *f) {
+    return coinc_engine_load(search->engine, f);
+}
+
+const engine_stats_t *coinc_stats(const coinc_t *search) {
+    return coinc_engine_stats(search->engine);
+}
+
+const engine_config_t *coinc_config(const coinc_t *search) {
+    return coinc_engine_config(search->engine);
+}
+
+engine_t *coinc_engine(coinc_t *search) {
+    return search->engine;
+}
@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_LIB_H
+#define COINC_LIB_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "coinc_event.h"
+#include "coinc_engine.h"
+
+/* libcoinc: coincidence search embedded in another program, e.g. a data acquisition, without going through files or
+ * pipes. Events are pushed in batches in input order, and the coincidences come out either through a callback as soon
+ * as they are found or, without a callback, are queued to be pulled with coinc_next(). The statistics can be read at
+ * any time. The search is that of coinc_engine.h, configured with an engine_config_t:
+ *
+ *     engine_config_t config;
+ *     coinc_engine_config_init(&config);
+ *     config.n_adcs=4;
+ *     config.time_window_low[1]=-100;
+ *     config.time_window_high[1]=100;
+ *     coinc_t *search=coinc_create(&config);
+ *     while(daq_read(events, &n)) {
+ *         coinc_push(search, events, n);
+ *         while((c=coinc_next(search)))
+ *             use(c);
+ *     }
+ *     coinc_finish(search);
+ *     ...
+ *
+ * The first coinc_create() selects the best window search kernel the CPU supports, unless coinc_kernel_select() of
+ * coinc_kernel.h has been called before to choose one. A coinc_t must be used from one thread at a time. */
+typedef struct coinc coinc_t;
+
+coinc_t *coinc_create(const engine_config_t *config); /* Returns NULL if memory could not be allocated */
+void coinc_free(coinc_t *search);
+/* Coincidences are passed to emit instead of being queued. Set before pushing any events. */
+void coinc_set_callback(coinc_t *search, engine_emit_function emit, void *context);
+/* Accidental coincidences of the delayed windows, which are only counted otherwise */
+void coinc_set_delayed_callback(coinc_t *search, engine_delayed_emit_function emit, void *context);
+
+/* Pushes n events, whose ADCs must be below n_adcs. Returns the number pushed, fewer than n if the search has stopped
+ * (the callback returned 0, or memory ran out, see coinc_failed()). */
+size_t coinc_push(coinc_t *search, const event *events, size_t n);
+/* Like coinc_push(), but the events are only partner candidates (see coinc_engine_push_halo()), e.g. the events just
+ * before and after a time range whose triggers are searched */
+size_t coinc_push_halo(coinc_t *search, const event *events, size_t n);
+int coinc_finish(coinc_t *search); /* End of input, the remaining triggers are processed. Returns 0 if the search failed. */
+int coinc_failed(const coinc_t *search); /* Non-zero if memory ran out */
+
+/* Next queued coincidence, or NULL if there is none. It is valid until the next call to coinc_next(), coinc_push() or
+ * coinc_finish(). The queue grows until it is emptied, so pull after every push. */
+const coincidence_t *coinc_next(coinc_t *search);
+
+/* Checkpoints (see coinc_engine_save()): the state of the search is saved to f, and loaded into a search created with
+ * the same configuration to continue with the events after the last one pushed. Queued coincidences are not saved, pull
+ * them first. Return 0 on failure. */
+int coinc_save(const coinc_t *search, FILE *f);
+int coinc_load(coinc_t *search, FILE *f);
+
+const engine_stats_t *coinc_stats(const coinc_t *search); /* Updated as events are pushed */
+const engine_config_t *coinc_config(const coinc_t *search);
+engine_t *coinc_engine(coinc_t *search); /* For the lower level functions of coinc_engine.h, e.g. coinc_engine_stats_add() */
+
+#endif /* COINC_LIB_H */
@@ -0,0 +1,167 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "coinc_merge.h"
+
+struct merge_source {
+    input_t *in;
+    const char *name;
+    int adc_offset;
+    long long int timestamp_offset;
+    unsigned long long int last_raw; /* Last timestamp as read, for detecting rollovers */
+    unsigned long long int rollover; /* Added to the raw timestamps */
+    event next; /* Next event of this input, valid while the source is in the heap */
+};
+
+struct merge {
+    int n_adcs;
+    unsigned int timestamp_bits;
+    unsigned long long int timestamp_mask;
+    struct merge_source *sources;
+    unsigned int n_sources;
+    unsigned int *heap; /* Indices of the sources that have an event, ordered by next.timestamp and then index */
+    unsigned int heap_size;
+    int started;
+    int error;
+};
+
+merge_t *merge_create(int n_adcs, unsigned int timestamp_bits) {
+    merge_t *m=calloc(1, sizeof(merge_t));
+    if(!m)
+        return NULL;
+    if(timestamp_bits == 0 || timestamp_bits > MERGE_TIMESTAMP_BITS_MAX)
+        timestamp_bits=MERGE_TIMESTAMP_BITS_MAX;
+    m->n_adcs=n_adcs;
+    m->timestamp_bits=timestamp_bits;
+    m->timestamp_mask=(timestamp_bits == 64)?~0ULL:(1ULL<<timestamp_bits)-1;
+    return m;
+}
+
+void merge_free(merge_t *m) {
+    unsigned int i;
+    if(!m)
+        return;
+    for(i=0; i < m->n_sources; i++) {
+        input_close(m->sources[i].in);
+    }
+    free(m->sources);
+    free(m->heap);
+    free(m);
+}
+
+int merge_add(merge_t *m, input_t *in, const char *name, int adc_offset, long long int timestamp_offset) {
+    struct merge_source *sources;
+    unsigned int *heap;
+    if(m->started)
+        return 0;
+    sources=realloc(m->sources, (m->n_sources+1)*sizeof(struct merge_source));
+    if(!sources)
+        return 0;
+    m->sources=sources;
+    heap=realloc(m->heap, (m->n_sources+1)*sizeof(unsigned int));
+    if(!heap)
+        return 0;
+    m->heap=heap;
+    sources[m->n_sources].in=in;
+    sources[m->n_sources].name=name;
+    sources[m->n_sources].adc_offset=adc_offset;
+    sources[m->n_sources].timestamp_offset=timestamp_offset;
+    sources[m->n_sources].last_raw=0;
+    sources[m->n_sources].rollover=0;
+    m->n_sources++;
+    return 1;
+}
+
+static int merge_before(const merge_t *m, unsigned int a, unsigned int b) {
+    const event *ea=&m->sources[a].next, *eb=&m->sources[b].next;
+    return ea->timestamp < eb->timestamp || (ea->timestamp == eb->timestamp && a < b);
+}
+
+static void merge_sift_down(merge_t *m, unsigned int pos) {
+    unsigned int child, top=m->heap[pos];
+    while((child=2*pos+1) < m->heap_size) {
+        if(child+1 < m->heap_size && merge_before(m, m->heap[child+1], m->heap[child]))
+            child++;
+        if(!merge_before(m, m->heap[child], top))
+            break;
+        m->heap[pos]=m->heap[child];
+        pos=child;
+    }
+    m->heap[pos]=top;
+}
+
+/* Reads the next event of a source into next. Returns 0 at its end or on error. */
+static int merge_source_read(merge_t *m, struct merge_source *s) {
+    char position[64];
+    unsigned long long int raw;
+    if(!input_read_event(s->in, &s->next)) {
+        if(input_error(s->in)) {
+            fprintf(stderr, "Error was in input %s.\n", s->name);
+            m->error=1;
+        }
+        return 0;
+    }
+    s->next.adc+=s->adc_offset;
+    if(s->next.adc < 0 || s->next.adc >= m->n_adcs) {
+        fprintf(stderr, "ADC value %i %s of input %s too high or negative, aborting. Check input file or try increasing number of ADCs (currently %i).\n",
+                s->next.adc, input_position(s->in, position, sizeof(position)), s->name, m->n_adcs);
+        m->error=1;
+        return 0;
+    }
+    raw=s->next.timestamp & m->timestamp_mask;
+    if(m->timestamp_bits < 64 && raw < s->last_raw && s->last_raw-raw > (m->timestamp_mask>>1))
+        s->rollover+=m->timestamp_mask+1;
+    s->last_raw=raw;
+    if(s->timestamp_offset < 0 && raw+s->rollover < -(unsigned long long int)s->timestamp_offset) {
+        fprintf(stderr, "Timestamp %llu %s of input %s is negative with timestamp offset %lli, aborting.\n",
+                raw+s->rollover, input_position(s->in, position, sizeof(position)), s->name, s->timestamp_offset);
+        m->error=1;
+        return 0;
+    }
+    s->next.timestamp=raw+s->rollover+(unsigned long long int)s->timestamp_offset;
+    return 1;
+}
+
+int merge_read_event(merge_t *m, event *event) {
+    unsigned int i, source;
+    if(m->error)
+        return 0;
+    if(!m->started) { /* Fill the heap with the first event of every input */
+        m->started=1;
+        for(i=0; i < m->n_sources; i++) {
+            if(merge_source_read(m, &m->sources[i]))
+                m->heap[m->heap_size++]=i;
+            if(m->error)
+                return 0;
+        }
+        for(i=m->heap_size/2; i-- > 0;) {
+            merge_sift_down(m, i);
+        }
+    }
+    if(!m->heap_size)
+        return 0;
+    source=m->heap[0];
+    *event=m->sources[source].next;
+    if(!merge_source_read(m, &m->sources[source])) {
+        if(m->error) /* Stop after this event */
+            return 1;
+        m->heap[0]=m->heap[--m->heap_size];
+    }
+    if(m->heap_size)
+        merge_sift_down(m, 0);
+    return 1;
+}
+
+int merge_error(const merge_t *m) {
+    return m->error;
+}
@@ -0,0 +1,36 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_MERGE_H
+#define COINC_MERGE_H
+
+#include "coinc_input.h"
+
+#define MERGE_TIMESTAMP_BITS_MAX 64
+
+/* Merges several time-ordered inputs (e.g. one file per digitizer board) into one time-ordered stream of events. The
+ * next event of every input is kept in a binary heap keyed on the timestamp, so memory does not grow with the length
+ * of the inputs, only with their number. Events with equal timestamps come in the order the inputs were added.
+ *
+ * Each input may have its own ADC offset (added to the ADC of its events) and timestamp offset (added to its
+ * timestamps, e.g. to align boards started at different times; a timestamp it makes negative is an error, like a
+ * malformed event). If the timestamp counters are narrower than 64 bits, timestamp_bits is their width: the timestamps
+ * of each input are unwrapped, so that a counter rolling over from 2^timestamp_bits-1 to 0 continues from
+ * 2^timestamp_bits. A timestamp dropping by more than half of the counter range is taken as a rollover. */
+typedef struct merge merge_t;
+
+merge_t *merge_create(int n_adcs, unsigned int timestamp_bits); /* Returns NULL on failure */
+int merge_add(merge_t *m, input_t *in, const char *name, int adc_offset, long long int timestamp_offset); /* m takes ownership of in. name is used in messages. Returns 0 on failure. */
+int merge_read_event(merge_t *m, event *event); /* Returns 1 on success, 0 when all inputs have ended or reading one of them failed */
+int merge_error(const merge_t *m); /* Non-zero if reading stopped because of malformed input */
+void merge_free(merge_t *m); /* Closes the inputs */
+
+#endif /* COINC_MERGE_H */
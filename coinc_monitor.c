@@ -0,0 +1,122 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include "coinc_monitor.h"
+#include "coinc_input.h"
+
+#define MONITOR_SIZE_INITIAL 4096
+
+struct monitor {
+    unsigned long long int *timestamps;
+    unsigned long long int n_events;
+    int sorted; /* Timestamps never decrease, so they can be bisected */
+};
+
+monitor_t *monitor_open(const char *filename) {
+    input_t *in=input_open_quiet(filename, INPUT_FORMAT_TEXT);
+    monitor_t *m;
+    unsigned long long int size=MONITOR_SIZE_INITIAL, *timestamps;
+    event monitor_event;
+    if(!in)
+        return NULL;
+    m=malloc(sizeof(monitor_t));
+    if(!m) {
+        input_close(in);
+        return NULL;
+    }
+    m->n_events=0;
+    m->sorted=1;
+    m->timestamps=malloc(size*sizeof(unsigned long long int));
+    while(m->timestamps && input_read_event(in, &monitor_event)) {
+        if(m->n_events == size) {
+            size*=2;
+            timestamps=realloc(m->timestamps, size*sizeof(unsigned long long int));
+            if(!timestamps) {
+                free(m->timestamps);
+                m->timestamps=NULL;
+                break;
+            }
+            m->timestamps=timestamps;
+        }
+        if(m->n_events && monitor_event.timestamp < m->timestamps[m->n_events-1])
+            m->sorted=0;
+        m->timestamps[m->n_events++]=monitor_event.timestamp;
+    }
+    input_close(in);
+    if(!m->timestamps) {
+        free(m);
+        return NULL;
+    }
+    return m;
+}
+
+void monitor_free(monitor_t *m) {
+    if(!m)
+        return;
+    free(m->timestamps);
+    free(m);
+}
+
+unsigned long long int monitor_n_events(const monitor_t *m) {
+    return m->n_events;
+}
+
+void monitor_cursor_init(monitor_cursor_t *cursor, const monitor_t *m) {
+    cursor->monitor=m;
+    cursor->position=0;
+    cursor->last_timestamp=0;
+}
+
+/* First event at or after position with a timestamp of at least timestamp, n_events if there is none */
+static unsigned long long int monitor_find(const monitor_t *m, unsigned long long int position, unsigned long long int timestamp) {
+    unsigned long long int low=position, high, step=1, middle;
+    const unsigned long long int *t=m->timestamps;
+    if(!m->sorted) {
+        while(position < m->n_events && t[position] < timestamp)
+            position++;
+        return position;
+    }
+    /* Gallop until t[high] >= timestamp, then bisect: t[low-1] < timestamp <= t[high] */
+    high=position;
+    while(high < m->n_events && t[high] < timestamp) {
+        low=high+1;
+        high+=step;
+        step*=2;
+    }
+    if(high > m->n_events)
+        high=m->n_events;
+    while(low < high) {
+        middle=low+(high-low)/2;
+        if(t[middle] < timestamp) {
+            low=middle+1;
+        } else {
+            high=middle;
+        }
+    }
+    return low;
+}
+
+long long int monitor_count(monitor_cursor_t *cursor, unsigned long long int timestamp) {
+    const monitor_t *m=cursor->monitor;
+    unsigned long long int found;
+    if(timestamp > cursor->last_timestamp && cursor->position < m->n_events) {
+        found=monitor_find(m, cursor->position, timestamp);
+        if(found < m->n_events) {
+            cursor->last_timestamp=m->timestamps[found];
+            cursor->position=found+1;
+        } else {
+            cursor->last_timestamp=m->timestamps[m->n_events-1];
+            cursor->position=m->n_events;
+        }
+    }
+    return (long long int)cursor->position-1;
+}
@@ -0,0 +1,42 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_MONITOR_H
+#define COINC_MONITOR_H
+
+#include "coinc_event.h"
+
+/* Monitor file (--monitor): a text list of "adc channel timestamp" events, e.g. from a beam monitor, whose running
+ * count is written next to every coincidence. The file is read once into an index of its timestamps, which any number
+ * of writers (threads, chunks of --parallel, --rules) share read-only. Reading stops at the first malformed line, the
+ * monitor file has no header line. */
+typedef struct monitor monitor_t;
+
+/* Position of one writer in a monitor. Triggers come mostly in time order, so the next one is searched from where the
+ * previous one was found, by galloping ahead and bisecting the last step. */
+struct monitor_cursor {
+    const monitor_t *monitor;
+    unsigned long long int position; /* Monitor events counted so far */
+    unsigned long long int last_timestamp; /* Timestamp of the last monitor event counted */
+};
+
+typedef struct monitor_cursor monitor_cursor_t;
+
+monitor_t *monitor_open(const char *filename); /* Returns NULL if the file could not be read or memory allocated */
+void monitor_free(monitor_t *m);
+unsigned long long int monitor_n_events(const monitor_t *m);
+void monitor_cursor_init(monitor_cursor_t *cursor, const monitor_t *m);
+
+/* Counts the monitor events up to and including the first one at or after timestamp, unless the last one counted is
+ * already there. Returns the count minus one, i.e. -1 before the first monitor event. */
+long long int monitor_count(monitor_cursor_t *cursor, unsigned long long int timestamp);
+
+#endif /* COINC_MONITOR_H */
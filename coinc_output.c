@@ -0,0 +1,188 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "coinc_output.h"
+
+#define OUTPUT_DIGITS_MAX 20 /* Digits in the largest 64-bit number */
+
+struct output {
+    FILE *f;
+    char *buffer;
+    size_t length;
+    int error;
+};
+
+output_t *output_open(FILE *f) {
+    output_t *out;
+    if(!f)
+        return NULL;
+    out=malloc(sizeof(output_t));
+    if(!out)
+        return NULL;
+    out->buffer=malloc(OUTPUT_BUFFER_SIZE);
+    if(!out->buffer) {
+        free(out);
+        return NULL;
+    }
+    out->f=f;
+    out->length=0;
+    out->error=0;
+    return out;
+}
+
+static void output_write(output_t *out) {
+    if(out->length && fwrite(out->buffer, 1, out->length, out->f) != out->length) {
+        out->error=1;
+    }
+    out->length=0;
+}
+
+int output_flush(output_t *out) {
+    output_write(out);
+    if(fflush(out->f))
+        out->error=1;
+    return !out->error;
+}
+
+int output_close(output_t *out) {
+    int ok;
+    if(!out)
+        return 1;
+    ok=output_flush(out);
+    free(out->buffer);
+    free(out);
+    return ok;
+}
+
+int output_append(output_t *out, FILE *f) {
+    size_t n_read;
+    output_write(out);
+    while((n_read=fread(out->buffer, 1, OUTPUT_BUFFER_SIZE, f)) > 0) {
+        out->length=n_read;
+        output_write(out);
+    }
+    if(ferror(f))
+        out->error=1;
+    return !out->error;
+}
+
+static char *output_reserve(output_t *out, size_t n) { /* n must be small compared to OUTPUT_BUFFER_SIZE */
+    if(out->length+n > OUTPUT_BUFFER_SIZE)
+        output_write(out);
+    return out->buffer+out->length;
+}
+
+/* Digits are produced backwards into a small scratch buffer and then copied after the padding. */
+static void output_digits(output_t *out, unsigned long long int value, int negative, unsigned int width) {
+    char digits[OUTPUT_DIGITS_MAX+1];
+    char *d=digits+sizeof(digits), *p;
+    unsigned int n;
+    do {
+        *--d=(char)('0'+value%10);
+        value/=10;
+    } while(value);
+    if(negative)
+        *--d='-';
+    n=(unsigned int)(digits+sizeof(digits)-d);
+    if(width < n)
+        width=n;
+    p=output_reserve(out, width);
+    memset(p, ' ', width-n);
+    memcpy(p+width-n, d, n);
+    out->length+=width;
+}
+
+void output_int(output_t *out, long long int value, unsigned int width) {
+    if(value < 0) {
+        output_digits(out, -(unsigned long long int)value, 1, width);
+    } else {
+        output_digits(out, (unsigned long long int)value, 0, width);
+    }
+}
+
+void output_uint(output_t *out, unsigned long long int value, unsigned int width) {
+    output_digits(out, value, 0, width);
+}
+
+void output_string(output_t *out, const char *s) {
+    size_t n=strlen(s);
+    if(n > OUTPUT_BUFFER_SIZE/2) { /* Too long to be worth buffering */
+        output_write(out);
+        if(fwrite(s, 1, n, out->f) != n)
+            out->error=1;
+        return;
+    }
+    memcpy(output_reserve(out, n), s, n);
+    out->length+=n;
+}
+
+void output_char(output_t *out, char c) {
+    *output_reserve(out, 1)=c;
+    out->length++;
+}
+
+void output_coincidence(output_t *out, output_mode mode, int triggertime, unsigned int n_monitors, const coincidence_t *c) {
+    unsigned int adc, i;
+    if(triggertime) {
+        output_uint(out, c->trigger_timestamp, 13);
+        output_char(out, ' ');
+    }
+    for(i=0; i < n_monitors; i++) {
+        output_int(out, c->monitor[i], 7);
+        output_char(out, ' ');
+    }
+    for(adc=0; adc < c->n_adcs; adc++) {
+        if(c->present[adc]) {
+            switch(mode) {
+                case MODE_RAW:
+                    output_int(out, c->channel[adc], 5);
+                    output_char(out, ' ');
+                    break;
+                case MODE_TIMESTAMPS:
+                    output_uint(out, c->timestamp[adc], 13);
+                    output_char(out, ' ');
+                    break;
+                case MODE_TIMEDIFF_AND_CHANNEL:
+                    output_int(out, c->channel[adc], 5);
+                    output_char(out, ' ');
+                    output_int(out, c->timediff[adc], 7);
+                    output_char(out, ' ');
+                    break;
+                case MODE_TIME_AND_CHANNEL:
+                    output_int(out, c->channel[adc], 5);
+                    output_char(out, ' ');
+                    output_uint(out, c->timestamp[adc], 13);
+                    output_char(out, ' ');
+                    break;
+                default:
+                    break;
+            }
+        } else {
+            switch(mode) {
+                case MODE_TIME_AND_CHANNEL:
+                    output_string(out, "    0             0 ");
+                    break;
+                case MODE_TIMEDIFF_AND_CHANNEL:
+                    output_string(out, "    0       0 ");
+                    break;
+                case MODE_TIMESTAMPS:
+                    output_string(out, "             0 ");
+                    break;
+                default:
+                    output_string(out, "     0 ");
+                    break;
+            }
+        }
+    }
+    output_char(out, '\n');
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_OUTPUT_H
+#define COINC_OUTPUT_H
+
+#include <stdio.h>
+#include "coinc_event.h"
+
+#define OUTPUT_BUFFER_SIZE (1<<20) /* Bytes collected before they are written out */
+
+/* Text output collected in a large buffer and written out only when the buffer fills, on output_flush() or when
+ * output_close() is called. Integers are formatted by hand, right aligned to a minimum width like printf("%5i") and
+ * printf("%13llu") would do. */
+typedef struct output output_t;
+
+typedef enum OUTPUT_MODE_E {
+    MODE_RAW = 0,
+    MODE_TIMESTAMPS = 1,
+    MODE_TIME_AND_CHANNEL = 2,
+    MODE_TIMEDIFF_AND_CHANNEL = 3
+} output_mode;
+
+#define OUTPUT_FORMAT_TEXT 0
+#define OUTPUT_FORMAT_COLUMNAR 1 /* See coinc_columnar.h */
+#define OUTPUT_FORMAT_NONE 2 /* Coincidences are only counted and accumulated in spectra */
+
+output_t *output_open(FILE *f); /* Returns NULL on failure */
+int output_close(output_t *out); /* Flushes and frees the buffer, f is left open. Returns 0 if any write failed. */
+int output_flush(output_t *out); /* Writes out the buffer and flushes f. Returns 0 if any write failed. */
+int output_append(output_t *out, FILE *f); /* Copies the rest of f to the output. Returns 0 if reading or any write failed. */
+void output_int(output_t *out, long long int value, unsigned int width);
+void output_uint(output_t *out, unsigned long long int value, unsigned int width);
+void output_string(output_t *out, const char *s);
+void output_char(output_t *out, char c);
+
+/* Writes one coincidence as a line of text in the given mode, optionally preceded by the trigger timestamp and the
+ * counts of the first n_monitors monitors. */
+void output_coincidence(output_t *out, output_mode mode, int triggertime, unsigned int n_monitors, const coincidence_t *c);
+
+#endif /* COINC_OUTPUT_H */
@@ -0,0 +1,310 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <coinc_config.h>
+#include "coinc_parallel.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+typedef enum JOB_STATE_E {
+    JOB_WAITING = 0,
+    JOB_RUNNING = 1,
+    JOB_DONE = 2
+} job_state;
+
+struct parallel_job {
+    unsigned long long begin, end; /* Byte offsets of the chunk, events starting in between belong to it */
+    job_state state;
+    void *sink;
+    engine_t *engine;
+    parallel_result result; /* PARALLEL_FAILED if the input could not be opened or memory ran out, PARALLEL_WRITE_FAILED if the sink failed */
+    int input_error; /* Reading stopped at malformed input before the end of the chunk */
+};
+
+struct parallel {
+    const char *filename;
+    input_format format;
+    unsigned long long data_begin;
+    unsigned long long chunk_size_min;
+    const engine_config_t *config;
+    const parallel_sink_t *sink;
+    long long int time_window_min, time_window_max, time_window_reach;
+    struct parallel_job *jobs;
+    unsigned int n_jobs;
+    unsigned int next_job;
+    int stop; /* Don't start any more jobs */
+    pthread_mutex_t lock;
+    pthread_cond_t job_done;
+};
+
+typedef struct parallel parallel_t;
+
+int parallel_available(void) {
+    return 1;
+}
+
+/* Finds where the worker of the chunk starting at begin should start reading. Events are read backwards in growing
+ * steps until the first event of a step is too early to be a partner of the first event of the chunk (the input is in
+ * time order, so neither is anything before it) or there is a discontinuity, which clears the buffers anyway. */
+static unsigned long long parallel_find_halo(const parallel_t *p, input_t *in, unsigned long long begin) {
+    unsigned long long step=PARALLEL_HALO_STEP, start, first_timestamp, last_timestamp=0;
+    event event;
+    int first, found;
+    if(begin <= p->data_begin)
+        return begin;
+    input_seek(in, begin);
+    if(!input_read_event(in, &event))
+        return begin;
+    first_timestamp=event.timestamp;
+    while(1) {
+        start=(begin-p->data_begin > step)?begin-step:p->data_begin;
+        start=input_seek(in, start);
+        if(start <= p->data_begin)
+            return p->data_begin;
+        first=1;
+        found=0;
+        while(!found && input_read_event(in, &event) && input_offset(in) <= begin) {
+            if(first) {
+                found=((long long int)(event.timestamp-first_timestamp) < p->time_window_min);
+                first=0;
+            } else if(event.timestamp < last_timestamp && last_timestamp-event.timestamp > (unsigned long long int)p->time_window_reach) {
+                found=1;
+            }
+            last_timestamp=event.timestamp;
+        }
+        if(found || input_error(in))
+            return start;
+        step*=2;
+    }
+}
+
+/* An event belongs to the chunk it starts in. Chunks begin at line (or record) boundaries, so an event ending at or
+ * before an offset also started before it. */
+static void parallel_run_job(const parallel_t *p, struct parallel_job *job) {
+    input_t *in=input_open_quiet(p->filename, p->format);
+    event event;
+    unsigned long long offset, last_timestamp=0, core_timestamp=0;
+    int in_core=0, ok=1;
+    if(!in) {
+        job->result=PARALLEL_FAILED;
+        return;
+    }
+    job->sink=p->sink->open(p->sink->context);
+    if(job->sink)
+        job->engine=coinc_engine_create(p->config, p->sink->write, job->sink);
+    if(!job->engine) {
+        job->result=job->sink?PARALLEL_FAILED:PARALLEL_WRITE_FAILED;
+        input_close(in);
+        return;
+    }
+    input_seek(in, parallel_find_halo(p, in, job->begin));
+    while(ok) {
+        offset=input_offset(in);
+        if(!input_read_adc_event(in, &event, p->config->n_adcs)) {
+            job->input_error=(input_error(in) && offset < job->end);
+            break;
+        }
+        offset=input_offset(in);
+        if(offset <= job->begin) {
+            ok=coinc_engine_push_halo(job->engine, &event);
+        } else if(offset <= job->end) {
+            ok=coinc_engine_push(job->engine, &event);
+            core_timestamp=event.timestamp;
+            in_core=1;
+        } else {
+            if(!in_core || (long long int)(event.timestamp-core_timestamp) > p->time_window_max)
+                break; /* The windows of the triggers of the chunk have closed */
+            if(event.timestamp < last_timestamp && last_timestamp-event.timestamp > (unsigned long long int)p->time_window_reach)
+                break; /* Discontinuity, the segment of the last triggers has ended */
+            ok=coinc_engine_push_halo(job->engine, &event);
+        }
+        last_timestamp=event.timestamp;
+    }
+    if(!coinc_engine_finish(job->engine)) {
+        job->result=PARALLEL_FAILED;
+    } else if(!ok) { /* Stopped by the sink */
+        job->result=PARALLEL_WRITE_FAILED;
+    }
+    input_close(in);
+}
+
+/* Workers read quietly, since a serial run would have stopped at the first error. It is reported by reading the chunk
+ * where it is again. */
+static void parallel_report_input_error(const parallel_t *p, const struct parallel_job *job) {
+    input_t *in=input_open(p->filename, p->format);
+    event event;
+    if(!in)
+        return;
+    input_seek_line(in, job->begin);
+    while(input_read_adc_event(in, &event, p->config->n_adcs)) {}
+    input_close(in);
+}
+
+static void *parallel_worker_main(void *arg) {
+    parallel_t *p=arg;
+    struct parallel_job *job;
+    while(1) {
+        pthread_mutex_lock(&p->lock);
+        if(p->stop || p->next_job == p->n_jobs) {
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+        job=&p->jobs[p->next_job++];
+        job->state=JOB_RUNNING;
+        pthread_mutex_unlock(&p->lock);
+        parallel_run_job(p, job);
+        pthread_mutex_lock(&p->lock);
+        job->state=JOB_DONE;
+        pthread_cond_broadcast(&p->job_done);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return NULL;
+}
+
+/* Splits the data into chunks of about the same size, each starting at the beginning of a line (or record). Returns
+ * the number of chunks, 0 on failure. */
+static unsigned int parallel_split(parallel_t *p, unsigned int n_threads) {
+    input_t *in=input_open_quiet(p->filename, p->format);
+    unsigned long long size, chunk_size, begin;
+    unsigned int n=n_threads*PARALLEL_CHUNKS_PER_THREAD, i;
+    if(!in)
+        return 0;
+    if(!input_seekable(in)) {
+        input_close(in);
+        return 0;
+    }
+    size=input_size(in)-p->data_begin;
+    if(size/p->chunk_size_min < n)
+        n=size/p->chunk_size_min;
+    if(n < 1)
+        n=1;
+    chunk_size=size/n;
+    p->jobs=calloc(n, sizeof(struct parallel_job));
+    if(!p->jobs) {
+        input_close(in);
+        return 0;
+    }
+    begin=p->data_begin;
+    for(i=0; i < n; i++) {
+        p->jobs[i].begin=begin;
+        p->jobs[i].end=(i == n-1)?input_size(in):input_seek(in, p->data_begin+(i+1)*chunk_size);
+        if(p->jobs[i].end < begin) /* A line longer than a chunk */
+            p->jobs[i].end=begin;
+        begin=p->jobs[i].end;
+    }
+    input_close(in);
+    return n;
+}
+
+parallel_result parallel_run(const char *filename, input_format format, unsigned long long data_begin, const engine_config_t *config, unsigned int n_threads, unsigned long long chunk_size_min, const parallel_sink_t *sink, engine_t *total) {
+    parallel_t p;
+    pthread_t *threads;
+    unsigned int i, n_started=0;
+    struct parallel_job *job;
+    parallel_result result=PARALLEL_OK;
+    int merging=1;
+    p.filename=filename;
+    p.format=format;
+    p.data_begin=data_begin;
+    p.chunk_size_min=chunk_size_min?chunk_size_min:PARALLEL_CHUNK_SIZE_MIN;
+    p.config=config;
+    p.sink=sink;
+    p.jobs=NULL;
+    p.next_job=0;
+    p.stop=0;
+    coinc_engine_config_reach(config, &p.time_window_min, &p.time_window_max, &p.time_window_reach);
+    if(n_threads < 1)
+        n_threads=1;
+    p.n_jobs=parallel_split(&p, n_threads);
+    if(!p.n_jobs)
+        return PARALLEL_FAILED;
+    if(n_threads > p.n_jobs)
+        n_threads=p.n_jobs;
+    threads=malloc(n_threads*sizeof(pthread_t));
+    if(!threads) {
+        free(p.jobs);
+        return PARALLEL_FAILED;
+    }
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.job_done, NULL);
+    for(i=0; i < n_threads; i++) {
+        if(pthread_create(&threads[i], NULL, parallel_worker_main, &p))
+            break;
+        n_started++;
+    }
+    if(!n_started) {
+        result=PARALLEL_FAILED;
+        merging=0;
+    }
+    for(i=0; i < p.n_jobs && n_started; i++) {
+        job=&p.jobs[i];
+        pthread_mutex_lock(&p.lock);
+        while(job->state == JOB_RUNNING || (job->state == JOB_WAITING && !p.stop))
+            pthread_cond_wait(&p.job_done, &p.lock);
+        pthread_mutex_unlock(&p.lock);
+        if(job->state == JOB_WAITING) /* Never started */
+            continue;
+        if(merging && job->result != PARALLEL_OK) {
+            result=job->result;
+            merging=0;
+        }
+        if(merging) {
+            coinc_engine_stats_add(total, coinc_engine_stats(job->engine));
+            if(!sink->merge(sink->context, job->sink)) {
+                result=PARALLEL_WRITE_FAILED;
+                merging=0;
+            }
+            if(job->input_error) { /* A serial run would stop here */
+                parallel_report_input_error(&p, job);
+                merging=0;
+            }
+        } else if(job->sink) {
+            sink->discard(sink->context, job->sink);
+        }
+        job->sink=NULL;
+        coinc_engine_free(job->engine);
+        job->engine=NULL;
+        if(!merging) {
+            pthread_mutex_lock(&p.lock);
+            p.stop=1;
+            pthread_mutex_unlock(&p.lock);
+        }
+    }
+    for(i=0; i < n_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&p.job_done);
+    pthread_mutex_destroy(&p.lock);
+    free(threads);
+    free(p.jobs);
+    return result;
+}
+
+#else /* No threads */
+
+int parallel_available(void) {
+    return 0;
+}
+
+parallel_result parallel_run(const char *filename, input_format format, unsigned long long data_begin, const engine_config_t *config, unsigned int n_threads, unsigned long long chunk_size_min, const parallel_sink_t *sink, engine_t *total) {
+    (void)filename;
+    (void)format;
+    (void)data_begin;
+    (void)config;
+    (void)n_threads;
+    (void)chunk_size_min;
+    (void)sink;
+    (void)total;
+    return PARALLEL_FAILED;
+}
+#endif
@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_PARALLEL_H
+#define COINC_PARALLEL_H
+
+#include "coinc_input.h"
+#include "coinc_engine.h"
+
+#define PARALLEL_CHUNKS_PER_THREAD 4 /* More chunks than threads evens out the load */
+#define PARALLEL_CHUNK_SIZE_MIN (1<<24) /* Bytes, smaller chunks are not worth the halos (default) */
+#define PARALLEL_HALO_STEP (1<<16) /* Bytes, first step when looking back for the halo of a chunk */
+
+/* Coincidence search over one time-ordered file with several threads. The file is split into chunks at line (or
+ * record) boundaries and every chunk is searched by its own engine. A chunk's triggers see the same partners as in a
+ * serial run, since each worker first pushes a halo of the events before the chunk (back to the earliest partner of
+ * its first trigger) and continues past the end of the chunk until the windows of its last triggers have closed. Halo
+ * events are pushed with coinc_engine_push_halo(), so every trigger and every event is counted by exactly one chunk.
+ *
+ * Each chunk writes its coincidences to its own sink. Sinks are merged in chunk order in the calling thread as soon as
+ * the chunks before them are done, so the output is in the same order as in a serial run. If a chunk stops at
+ * malformed input, the chunks after it are discarded, just like a serial run would stop there.
+ *
+ * The result is the same as in a serial run as long as the input is in time order (apart from discontinuities, see
+ * coinc_engine_config_reach()) and the coinc table never fills up. */
+
+struct parallel_sink {
+    void *(*open)(void *context); /* Called from a worker thread, returns NULL on failure */
+    engine_emit_function write; /* Called from the worker thread with the sink returned by open */
+    int (*merge)(void *context, void *sink); /* Called in chunk order from the calling thread, closes the sink. Returns 0 on failure. */
+    void (*discard)(void *context, void *sink); /* Closes a sink that is not needed */
+    void *context;
+};
+
+typedef struct parallel_sink parallel_sink_t;
+
+typedef enum PARALLEL_RESULT_E {
+    PARALLEL_OK = 0, /* Also when the input ended with an error, which has been reported already */
+    PARALLEL_FAILED = 1, /* Could not read the input, allocate memory or start threads */
+    PARALLEL_WRITE_FAILED = 2 /* A sink could not be opened or merged */
+} parallel_result;
+
+int parallel_available(void); /* Non-zero if threads are supported in this build */
+
+/* Searches the memory-mappable file from data_begin (after any header and skipped lines) to the end using n_threads
+ * worker threads, in chunks of at least chunk_size_min bytes (0 for PARALLEL_CHUNK_SIZE_MIN). The statistics of every
+ * merged chunk are added to total, an engine with the same configuration that is otherwise not used. */
+parallel_result parallel_run(const char *filename, input_format format, unsigned long long data_begin, const engine_config_t *config, unsigned int n_threads, unsigned long long chunk_size_min, const parallel_sink_t *sink, engine_t *total);
+
+#endif /* COINC_PARALLEL_H */
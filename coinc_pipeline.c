@@ -0,0 +1,315 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <coinc_config.h>
+#include "coinc_pipeline.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/* Ring of pointers with one producer and one consumer. head is only written by the consumer and tail only by the
+ * producer, so the positions need no locks, only acquire/release ordering for the items. */
+struct spsc_queue {
+    void *items[PIPELINE_QUEUE_DEPTH];
+    _Atomic unsigned long head;
+    _Atomic unsigned long tail;
+};
+
+typedef struct spsc_queue spsc_queue_t;
+
+struct event_batch {
+    unsigned int n;
+    int end; /* Last batch, the input ended */
+    event events[PIPELINE_BATCH_EVENTS];
+};
+
+struct coincidence_batch {
+    unsigned int n;
+    int end; /* Last batch, no more coincidences */
+    unsigned long long int trigger_timestamp[PIPELINE_BATCH_COINCIDENCES];
+    unsigned char *present; /* [row*n_adcs+adc] */
+    int *channel;
+    unsigned long long int *timestamp;
+    long long int *timediff;
+};
+
+struct pipeline {
+    unsigned int n_adcs;
+    pipeline_read_function read;
+    void *read_context;
+    pipeline_write_function write;
+    void *write_context;
+    pthread_t reader_thread;
+    pthread_t writer_thread;
+    spsc_queue_t events_full; /* Reader to engine */
+    spsc_queue_t events_free; /* Engine to reader */
+    spsc_queue_t coincidences_full; /* Engine to writer */
+    spsc_queue_t coincidences_free; /* Writer to engine */
+    struct event_batch *events; /* Batch being consumed */
+    unsigned int event_pos;
+    struct coincidence_batch *coincidences; /* Batch being filled */
+    _Atomic int stop; /* Tells the reader to quit */
+    int write_failed;
+};
+
+/* Waiting costs nothing at first, but backs off to sleeping, since a stage may wait for a long time on a slow
+ * neighbour (or a slow disk). */
+static void backoff(unsigned int *spins) {
+    struct timespec ts={0, 50000};
+    if(*spins < 64) {
+        (*spins)++;
+    } else if(*spins < 128) {
+        (*spins)++;
+        sched_yield();
+    } else {
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void queue_push(spsc_queue_t *q, void *item) { /* Never waits, every queue has room for all the batches */
+    unsigned long tail=atomic_load_explicit(&q->tail, memory_order_relaxed);
+    q->items[tail & (PIPELINE_QUEUE_DEPTH-1)]=item;
+    atomic_store_explicit(&q->tail, tail+1, memory_order_release);
+}
+
+static void *queue_pop(spsc_queue_t *q, _Atomic int *stop) { /* Waits for an item. Returns NULL if stop is set while waiting. */
+    unsigned long head=atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned int spins=0;
+    void *item;
+    while(atomic_load_explicit(&q->tail, memory_order_acquire) == head) {
+        if(stop && atomic_load_explicit(stop, memory_order_relaxed))
+            return NULL;
+        backoff(&spins);
+    }
+    item=q->items[head & (PIPELINE_QUEUE_DEPTH-1)];
+    atomic_store_explicit(&q->head, head+1, memory_order_release);
+    return item;
+}
+
+static void *reader_main(void *arg) {
+    pipeline_t *p=arg;
+    struct event_batch *batch;
+    int end=0;
+    while(!end && !atomic_load_explicit(&p->stop, memory_order_relaxed)) {
+        batch=queue_pop(&p->events_free, &p->stop);
+        if(!batch)
+            break;
+        for(batch->n=0; batch->n < PIPELINE_BATCH_EVENTS; batch->n++) {
+            if(!p->read(p->read_context, &batch->events[batch->n])) {
+                end=1;
+                break;
+            }
+        }
+        batch->end=end;
+        queue_push(&p->events_full, batch);
+    }
+    return NULL;
+}
+
+static void *writer_main(void *arg) {
+    pipeline_t *p=arg;
+    struct coincidence_batch *batch;
+    coincidence_t c;
+    unsigned int row;
+    int end=0;
+    c.n_adcs=p->n_adcs;
+    memset(c.monitor, 0, sizeof(c.monitor));
+    while(!end) {
+        batch=queue_pop(&p->coincidences_full, NULL);
+        for(row=0; row < batch->n; row++) {
+            c.trigger_timestamp=batch->trigger_timestamp[row];
+            c.present=batch->present+(size_t)row*p->n_adcs;
+            c.channel=batch->channel+(size_t)row*p->n_adcs;
+            c.timestamp=batch->timestamp+(size_t)row*p->n_adcs;
+            c.timediff=batch->timediff+(size_t)row*p->n_adcs;
+            if(!p->write_failed && !p->write(p->write_context, &c))
+                p->write_failed=1;
+        }
+        end=batch->end;
+        queue_push(&p->coincidences_free, batch);
+    }
+    return NULL;
+}
+
+static void coincidence_batch_free(struct coincidence_batch *batch) {
+    if(!batch)
+        return;
+    free(batch->present);
+    free(batch->channel);
+    free(batch->timestamp);
+    free(batch->timediff);
+    free(batch);
+}
+
+static struct coincidence_batch *coincidence_batch_alloc(unsigned int n_adcs) {
+    size_t n=(size_t)n_adcs*PIPELINE_BATCH_COINCIDENCES;
+    struct coincidence_batch *batch=calloc(1, sizeof(struct coincidence_batch));
+    if(!batch)
+        return NULL;
+    batch->present=malloc(n*sizeof(unsigned char));
+    batch->channel=malloc(n*sizeof(int));
+    batch->timestamp=malloc(n*sizeof(unsigned long long int));
+    batch->timediff=malloc(n*sizeof(long long int));
+    if(!batch->present || !batch->channel || !batch->timestamp || !batch->timediff) {
+        coincidence_batch_free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+static void pipeline_free(pipeline_t *p) {
+    unsigned int i;
+    for(i=0; i < PIPELINE_QUEUE_DEPTH; i++) { /* When the threads are not running, every batch is in a free queue */
+        free(p->events_free.items[i]);
+        coincidence_batch_free(p->coincidences_free.items[i]);
+    }
+    free(p);
+}
+
+int pipeline_available(void) {
+    return 1;
+}
+
+pipeline_t *pipeline_start(unsigned int n_adcs, pipeline_read_function read, void *read_context, pipeline_write_function write, void *write_context) {
+    pipeline_t *p=calloc(1, sizeof(pipeline_t));
+    unsigned int i;
+    if(!p)
+        return NULL;
+    p->n_adcs=n_adcs;
+    p->read=read;
+    p->read_context=read_context;
+    p->write=write;
+    p->write_context=write_context;
+    atomic_init(&p->events_full.head, 0);
+    atomic_init(&p->events_full.tail, 0);
+    atomic_init(&p->events_free.head, 0);
+    atomic_init(&p->events_free.tail, PIPELINE_QUEUE_DEPTH);
+    atomic_init(&p->coincidences_full.head, 0);
+    atomic_init(&p->coincidences_full.tail, 0);
+    atomic_init(&p->coincidences_free.head, 0);
+    atomic_init(&p->coincidences_free.tail, PIPELINE_QUEUE_DEPTH);
+    atomic_init(&p->stop, 0);
+    for(i=0; i < PIPELINE_QUEUE_DEPTH; i++) {
+        p->events_free.items[i]=malloc(sizeof(struct event_batch));
+        p->coincidences_free.items[i]=coincidence_batch_alloc(n_adcs);
+        if(!p->events_free.items[i] || !p->coincidences_free.items[i]) {
+            pipeline_free(p);
+            return NULL;
+        }
+    }
+    if(pthread_create(&p->reader_thread, NULL, reader_main, p)) {
+        pipeline_free(p);
+        return NULL;
+    }
+    if(pthread_create(&p->writer_thread, NULL, writer_main, p)) {
+        atomic_store(&p->stop, 1);
+        pthread_join(p->reader_thread, NULL);
+        pipeline_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+int pipeline_read_event(pipeline_t *p, event *event) {
+    if(p->events && p->event_pos == p->events->n) {
+        if(p->events->end)
+            return 0;
+        queue_push(&p->events_free, p->events);
+        p->events=NULL;
+    }
+    if(!p->events) {
+        p->events=queue_pop(&p->events_full, NULL);
+        p->event_pos=0;
+        if(!p->events->n) /* Only possible at the end */
+            return 0;
+    }
+    *event=p->events->events[p->event_pos++];
+    return 1;
+}
+
+void pipeline_write(pipeline_t *p, const coincidence_t *c) {
+    struct coincidence_batch *batch=p->coincidences;
+    size_t row_offset;
+    if(!batch) {
+        batch=queue_pop(&p->coincidences_free, NULL);
+        batch->n=0;
+        batch->end=0;
+        p->coincidences=batch;
+    }
+    row_offset=(size_t)batch->n*p->n_adcs;
+    batch->trigger_timestamp[batch->n]=c->trigger_timestamp;
+    memcpy(batch->present+row_offset, c->present, p->n_adcs*sizeof(unsigned char));
+    memcpy(batch->channel+row_offset, c->channel, p->n_adcs*sizeof(int));
+    memcpy(batch->timestamp+row_offset, c->timestamp, p->n_adcs*sizeof(unsigned long long int));
+    memcpy(batch->timediff+row_offset, c->timediff, p->n_adcs*sizeof(long long int));
+    batch->n++;
+    if(batch->n == PIPELINE_BATCH_COINCIDENCES) {
+        queue_push(&p->coincidences_full, batch);
+        p->coincidences=NULL;
+    }
+}
+
+int pipeline_stop(pipeline_t *p) {
+    int ok;
+    if(!p->coincidences) {
+        p->coincidences=queue_pop(&p->coincidences_free, NULL);
+        p->coincidences->n=0;
+    }
+    p->coincidences->end=1;
+    queue_push(&p->coincidences_full, p->coincidences);
+    pthread_join(p->writer_thread, NULL);
+    atomic_store(&p->stop, 1);
+    if(p->events)
+        queue_push(&p->events_free, p->events);
+    pthread_join(p->reader_thread, NULL);
+    while(atomic_load(&p->events_full.head) != atomic_load(&p->events_full.tail)) /* Batches the reader got ahead with */
+        queue_push(&p->events_free, queue_pop(&p->events_full, NULL));
+    ok=!p->write_failed;
+    pipeline_free(p);
+    return ok;
+}
+
+#else /* No threads, the pipeline is never started */
+
+int pipeline_available(void) {
+    return 0;
+}
+
+pipeline_t *pipeline_start(unsigned int n_adcs, pipeline_read_function read, void *read_context, pipeline_write_function write, void *write_context) {
+    (void)n_adcs;
+    (void)read;
+    (void)read_context;
+    (void)write;
+    (void)write_context;
+    return NULL;
+}
+
+int pipeline_read_event(pipeline_t *p, event *event) {
+    (void)p;
+    (void)event;
+    return 0;
+}
+
+void pipeline_write(pipeline_t *p, const coincidence_t *c) {
+    (void)p;
+    (void)c;
+}
+
+int pipeline_stop(pipeline_t *p) {
+    (void)p;
+    return 0;
+}
+#endif
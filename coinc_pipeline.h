@@ -0,0 +1,39 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_PIPELINE_H
+#define COINC_PIPELINE_H
+
+#include "coinc_event.h"
+
+#define PIPELINE_BATCH_EVENTS 4096 /* Events passed from the reader at a time */
+#define PIPELINE_BATCH_COINCIDENCES 1024 /* Coincidences passed to the writer at a time */
+#define PIPELINE_QUEUE_DEPTH 8 /* Batches in flight between two stages, power of two */
+
+/* Three-stage pipeline: a reader thread reads events in batches and a writer thread writes coincidences in batches,
+ * while the thread using the pipeline runs the coincidence search in between. Batches are passed through bounded
+ * lock-free single-producer single-consumer queues and recycled through a second queue going the other way, so
+ * nothing is allocated after the start. Everything stays in input order, so the output is the same as without
+ * the pipeline. */
+typedef struct pipeline pipeline_t;
+
+typedef int (*pipeline_read_function)(void *context, event *event); /* Returns 1 for an event, 0 at the end of input */
+typedef int (*pipeline_write_function)(void *context, coincidence_t *c); /* Returns 0 if writing failed */
+
+int pipeline_available(void); /* Non-zero if threads are supported in this build */
+
+/* Starts the reader and writer threads. read and write are only called from these threads. Returns NULL on failure. */
+pipeline_t *pipeline_start(unsigned int n_adcs, pipeline_read_function read, void *read_context, pipeline_write_function write, void *write_context);
+int pipeline_read_event(pipeline_t *p, event *event); /* Next event from the reader. Returns 0 at the end of input. */
+void pipeline_write(pipeline_t *p, const coincidence_t *c); /* Copies c to the writer queue */
+int pipeline_stop(pipeline_t *p); /* Lets the writer finish, stops the reader and frees p. Returns 0 if any write failed. */
+
+#endif /* COINC_PIPELINE_H */
@@ -0,0 +1,177 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "coinc_rules.h"
+
+static char *trim(char *s) {
+    char *end;
+    while(*s == ' ' || *s == '\t')
+        s++;
+    end=s+strlen(s);
+    while(end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+        end--;
+    *end='\0';
+    return s;
+}
+
+static int rules_adc_ok(const rule_t *rule, int adc) {
+    return adc >= 0 && (unsigned int)adc < rule->config.n_adcs;
+}
+
+/* Applies one option to rule. Returns 0 if the option is not valid. */
+static int rules_option(rule_t *rule, const char *option) {
+    engine_config_t *config=&rule->config;
+    int adc;
+    unsigned int i;
+    long long int value;
+    char c;
+    if(strcmp(option, "timestamps") == 0) {
+        rule->mode=MODE_TIMESTAMPS;
+    } else if(strcmp(option, "both") == 0) {
+        rule->mode=MODE_TIME_AND_CHANNEL;
+    } else if(strcmp(option, "timediff") == 0) {
+        rule->mode=MODE_TIMEDIFF_AND_CHANNEL;
+    } else if(strcmp(option, "extending") == 0) {
+        config->build_extending=1;
+    } else if(strcmp(option, "triggertime") == 0) {
+        rule->triggertime=1;
+    } else if(strcmp(option, "output-format=text") == 0) {
+        rule->output_format=OUTPUT_FORMAT_TEXT;
+    } else if(strcmp(option, "output-format=columnar") == 0) {
+        rule->output_format=OUTPUT_FORMAT_COLUMNAR;
+    } else if(strcmp(option, "output-format=none") == 0) {
+        rule->output_format=OUTPUT_FORMAT_NONE;
+    } else if(strncmp(option, "output=", 7) == 0 && option[7]) {
+        free(rule->output_filename);
+        rule->output_filename=strdup(option+7);
+        return rule->output_filename != NULL;
+    } else if(sscanf(option, "trigger=%i%c", &adc, &c) == 1) {
+        if(!rules_adc_ok(rule, adc))
+            return 0;
+        config->trigger_adc=adc;
+    } else if(sscanf(option, "triggerless=%llu%c", &config->build_window, &c) == 1) {
+        config->trigger_adc=ENGINE_TRIGGERLESS;
+    } else if(sscanf(option, "delayed=%lli%c", &value, &c) == 1) {
+        if(config->n_delays == ENGINE_DELAYS_MAX)
+            return 0;
+        config->delay[config->n_delays++]=value;
+    } else if(sscanf(option, "require=%i%c", &adc, &c) == 1) {
+        if(!rules_adc_ok(rule, adc))
+            return 0;
+        config->require[adc]=1;
+    } else if(sscanf(option, "multiplicity=%i%c", &config->min_multiplicity, &c) == 1) {
+        return 1;
+    } else if(sscanf(option, "low=%i,%lli%c", &adc, &value, &c) == 2) {
+        if(!rules_adc_ok(rule, adc))
+            return 0;
+        config->time_window_low[adc]=value;
+    } else if(sscanf(option, "low=%lli%c", &value, &c) == 1) {
+        for(i=0; i < config->n_adcs; i++) {
+            config->time_window_low[i]=value;
+        }
+    } else if(sscanf(option, "high=%i,%lli%c", &adc, &value, &c) == 2) {
+        if(!rules_adc_ok(rule, adc))
+            return 0;
+        config->time_window_high[adc]=value;
+    } else if(sscanf(option, "high=%lli%c", &value, &c) == 1) {
+        for(i=0; i < config->n_adcs; i++) {
+            config->time_window_high[i]=value;
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+void rules_free(rule_t *rules, unsigned int n_rules) {
+    unsigned int i;
+    if(!rules)
+        return;
+    for(i=0; i < n_rules; i++) {
+        free(rules[i].output_filename);
+    }
+    free(rules);
+}
+
+unsigned int rules_read(const char *filename, const rule_t *defaults, rule_t **rules) {
+    FILE *f=fopen(filename, "r");
+    char line[RULES_LINE_MAX], *s, *end;
+    unsigned int n_rules=0, line_number=0, i;
+    rule_t *r;
+    int ok=1;
+    if(!f) {
+        fprintf(stderr, "Could not open rules file \"%s\".\n", filename);
+        return 0;
+    }
+    *rules=calloc(RULES_MAX, sizeof(rule_t));
+    if(!*rules) {
+        fclose(f);
+        return 0;
+    }
+    while(ok && fgets(line, sizeof(line), f)) {
+        line_number++;
+        s=trim(line);
+        if(!*s || *s == '#')
+            continue;
+        if(*s == '[') {
+            end=strchr(s, ']');
+            if(!end || end[1] || end == s+1 || end-s-1 >= RULES_NAME_MAX) {
+                fprintf(stderr, "Rules file %s, line %u: bad definition name \"%s\".\n", filename, line_number, s);
+                ok=0;
+                break;
+            }
+            if(n_rules == RULES_MAX) {
+                fprintf(stderr, "Rules file %s, line %u: too many definitions, at most %i are allowed.\n", filename, line_number, RULES_MAX);
+                ok=0;
+                break;
+            }
+            r=&(*rules)[n_rules++];
+            *r=*defaults;
+            r->output_filename=NULL;
+            memcpy(r->name, s+1, end-s-1);
+            r->name[end-s-1]='\0';
+            for(i=0; i+1 < n_rules; i++) {
+                if(strcmp((*rules)[i].name, r->name) == 0) {
+                    fprintf(stderr, "Rules file %s, line %u: definition \"%s\" is given twice.\n", filename, line_number, r->name);
+                    ok=0;
+                }
+            }
+            continue;
+        }
+        if(!n_rules) {
+            fprintf(stderr, "Rules file %s, line %u: options must follow a definition name in brackets.\n", filename, line_number);
+            ok=0;
+        } else if(!rules_option(&(*rules)[n_rules-1], s)) {
+            fprintf(stderr, "Rules file %s, line %u: invalid option \"%s\".\n", filename, line_number, s);
+            ok=0;
+        }
+    }
+    fclose(f);
+    for(i=0; ok && i < n_rules; i++) {
+        if((*rules)[i].config.build_extending && (*rules)[i].config.trigger_adc != ENGINE_TRIGGERLESS) {
+            fprintf(stderr, "Rules file %s: definition \"%s\" has extending but not triggerless.\n", filename, (*rules)[i].name);
+            ok=0;
+        }
+    }
+    if(ok && !n_rules) {
+        fprintf(stderr, "Rules file %s has no definitions.\n", filename);
+        ok=0;
+    }
+    if(!ok) {
+        rules_free(*rules, n_rules);
+        *rules=NULL;
+        return 0;
+    }
+    return n_rules;
+}
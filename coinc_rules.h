@@ -0,0 +1,54 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_RULES_H
+#define COINC_RULES_H
+
+#include "coinc_engine.h"
+#include "coinc_output.h"
+
+#define RULES_NAME_MAX 64
+#define RULES_LINE_MAX 4096
+#define RULES_MAX 64
+
+/* One coincidence definition and where its coincidences go */
+struct rule {
+    char name[RULES_NAME_MAX];
+    engine_config_t config;
+    output_mode mode;
+    int triggertime;
+    int output_format; /* OUTPUT_FORMAT_* */
+    char *output_filename; /* NULL or "-" for standard output */
+};
+
+typedef struct rule rule_t;
+
+/* Reads coincidence definitions from a rules file. Each definition starts with its name in brackets, followed by
+ * options one per line, written like the command line options of coinc without the leading "--":
+ *
+ *   # ToF-E coincidences
+ *   [tof-e]
+ *   trigger=0
+ *   low=-20
+ *   high=20
+ *   require=1
+ *   timediff
+ *   output=tof-e.txt
+ *
+ * Options: trigger=ADC, low=NUM, low=ADC,NUM, high=NUM, high=ADC,NUM, require=ADC, multiplicity=NUM,
+ * triggerless=NUM, extending, delayed=NUM (accidental coincidences are only counted), timestamps, both, timediff, triggertime, output-format=text|columnar|none and output=FILE. Whatever is not given is taken
+ * from defaults (number of ADCs, table size, windows and so on). Empty lines and lines starting with # are ignored.
+ *
+ * Returns the number of definitions, 0 after printing an error. *rules is allocated, free it with rules_free(). */
+unsigned int rules_read(const char *filename, const rule_t *defaults, rule_t **rules);
+void rules_free(rule_t *rules, unsigned int n_rules);
+
+#endif /* COINC_RULES_H */
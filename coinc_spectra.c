@@ -0,0 +1,237 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "coinc_spectra.h"
+#include "coinc_binary.h"
+
+#define SPECTRUM_WRITE_BLOCK 4096 /* Counts converted at a time */
+
+struct spectrum {
+    spectrum_definition_t definition;
+    histogram_axis_t axes[2];
+    unsigned int n_axes;
+    unsigned long long int *counts;
+    unsigned long long int outside;
+};
+
+struct spectra {
+    struct spectrum *spectra;
+    unsigned int n_spectra;
+};
+
+static size_t spectrum_size(const struct spectrum *s) {
+    return (size_t)s->axes[0].n_bins*(s->n_axes == 2?s->axes[1].n_bins:1);
+}
+
+static spectra_t *spectra_alloc(unsigned int n_spectra) {
+    spectra_t *s=calloc(1, sizeof(spectra_t));
+    if(!s)
+        return NULL;
+    s->spectra=calloc(n_spectra, sizeof(struct spectrum));
+    if(!s->spectra) {
+        free(s);
+        return NULL;
+    }
+    s->n_spectra=n_spectra;
+    return s;
+}
+
+/* Allocates the counts of every spectrum, whose axes are set. Frees s on failure. */
+static spectra_t *spectra_alloc_counts(spectra_t *s) {
+    unsigned int i;
+    for(i=0; i < s->n_spectra; i++) {
+        s->spectra[i].counts=calloc(spectrum_size(&s->spectra[i]), sizeof(unsigned long long int));
+        if(!s->spectra[i].counts) {
+            spectra_free(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+spectra_t *spectra_create(const spectrum_definition_t *definitions, unsigned int n_spectra, long long int channels, unsigned int matrix_bins, const engine_config_t *config) {
+    spectra_t *s=spectra_alloc(n_spectra);
+    struct spectrum *spectrum;
+    unsigned int i, adc;
+    int ok=1;
+    if(!s)
+        return NULL;
+    for(i=0; i < n_spectra; i++) {
+        spectrum=&s->spectra[i];
+        spectrum->definition=definitions[i];
+        switch(definitions[i].type) {
+            case SPECTRUM_CHANNELS:
+                spectrum->n_axes=1;
+                ok=ok && coinc_histogram_axis_init(&spectrum->axes[0], 0, channels-1, 1, 0, HISTOGRAM_BINS_DEFAULT);
+                break;
+            case SPECTRUM_MATRIX:
+                spectrum->n_axes=2;
+                ok=ok && coinc_histogram_axis_init(&spectrum->axes[0], 0, channels-1, 1, 0, matrix_bins);
+                spectrum->axes[1]=spectrum->axes[0];
+                break;
+            case SPECTRUM_TIMEDIFF_MATRIX:
+                adc=(unsigned int)definitions[i].adc_x;
+                spectrum->n_axes=2;
+                ok=ok && coinc_histogram_axis_init(&spectrum->axes[0], 0, channels-1, 1, 0, matrix_bins);
+                ok=ok && coinc_histogram_axis_init(&spectrum->axes[1], config->time_window_low[adc], config->time_window_high[adc], config->histogram_width, config->histogram_log, matrix_bins);
+                break;
+        }
+    }
+    if(!ok) {
+        spectra_free(s);
+        return NULL;
+    }
+    return spectra_alloc_counts(s);
+}
+
+spectra_t *spectra_create_empty(const spectra_t *s) {
+    spectra_t *empty=spectra_alloc(s->n_spectra);
+    unsigned int i;
+    if(!empty)
+        return NULL;
+    for(i=0; i < s->n_spectra; i++) {
+        empty->spectra[i]=s->spectra[i];
+        empty->spectra[i].counts=NULL;
+        empty->spectra[i].outside=0;
+    }
+    return spectra_alloc_counts(empty);
+}
+
+void spectra_free(spectra_t *s) {
+    unsigned int i;
+    if(!s)
+        return;
+    for(i=0; i < s->n_spectra; i++) {
+        free(s->spectra[i].counts);
+    }
+    free(s->spectra);
+    free(s);
+}
+
+static void spectrum_fill(struct spectrum *s, long long int x, long long int y) {
+    long long int bin_x=coinc_histogram_axis_bin(&s->axes[0], x), bin_y=0;
+    if(s->n_axes == 2)
+        bin_y=coinc_histogram_axis_bin(&s->axes[1], y);
+    if(bin_x < 0 || bin_x >= s->axes[0].n_bins || bin_y < 0 || (s->n_axes == 2 && bin_y >= s->axes[1].n_bins)) {
+        s->outside++;
+        return;
+    }
+    s->counts[(size_t)bin_y*s->axes[0].n_bins+(size_t)bin_x]++;
+}
+
+void spectra_fill(spectra_t *s, const coincidence_t *c) {
+    unsigned int i;
+    struct spectrum *spectrum;
+    for(i=0; i < s->n_spectra; i++) {
+        spectrum=&s->spectra[i];
+        if(!c->present[spectrum->definition.adc_x])
+            continue;
+        switch(spectrum->definition.type) {
+            case SPECTRUM_CHANNELS:
+                spectrum_fill(spectrum, c->channel[spectrum->definition.adc_x], 0);
+                break;
+            case SPECTRUM_MATRIX:
+                if(c->present[spectrum->definition.adc_y])
+                    spectrum_fill(spectrum, c->channel[spectrum->definition.adc_x], c->channel[spectrum->definition.adc_y]);
+                break;
+            case SPECTRUM_TIMEDIFF_MATRIX:
+                spectrum_fill(spectrum, c->channel[spectrum->definition.adc_x], c->timediff[spectrum->definition.adc_x]);
+                break;
+        }
+    }
+}
+
+void spectra_add(spectra_t *s, const spectra_t *other) {
+    unsigned int i;
+    size_t bin, size;
+    for(i=0; i < s->n_spectra; i++) {
+        size=spectrum_size(&s->spectra[i]);
+        for(bin=0; bin < size; bin++) {
+            s->spectra[i].counts[bin]+=other->spectra[i].counts[bin];
+        }
+        s->spectra[i].outside+=other->spectra[i].outside;
+    }
+}
+
+static void spectrum_put_axis(unsigned char *p, const histogram_axis_t *axis) {
+    binary_put_u64(p, (uint64_t)axis->low);
+    binary_put_u64(p+8, (uint64_t)axis->high);
+    binary_put_u64(p+16, axis->log_k?0:(uint64_t)axis->width);
+    binary_put_u32(p+24, axis->log_k);
+    binary_put_u32(p+28, axis->n_bins);
+}
+
+/* Writes n values from get(i) as 8-byte integers */
+static int spectrum_write_values(FILE *f, size_t n, uint64_t (*get)(const void *data, size_t i), const void *data) {
+    unsigned char block[8*SPECTRUM_WRITE_BLOCK];
+    size_t i, j, m;
+    for(i=0; i < n; i+=m) {
+        m=n-i < SPECTRUM_WRITE_BLOCK?n-i:SPECTRUM_WRITE_BLOCK;
+        for(j=0; j < m; j++) {
+            binary_put_u64(block+8*j, get(data, i+j));
+        }
+        if(fwrite(block, 8, m, f) != m)
+            return 0;
+    }
+    return 1;
+}
+
+static uint64_t spectrum_edge(const void *axis, size_t bin) {
+    return (uint64_t)coinc_histogram_axis_edge(axis, (unsigned int)bin);
+}
+
+static uint64_t spectrum_count(const void *counts, size_t bin) {
+    return ((const unsigned long long int *)counts)[bin];
+}
+
+static int spectrum_write(const struct spectrum *s) {
+    unsigned char header[SPECTRUM_HEADER_SIZE];
+    unsigned int axis;
+    FILE *f=fopen(s->definition.filename, "wb");
+    int ok;
+    if(!f) {
+        fprintf(stderr, "Could not open file \"%s\" for output.\n", s->definition.filename);
+        return 0;
+    }
+    memset(header, 0, sizeof(header));
+    memcpy(header, SPECTRUM_MAGIC, SPECTRUM_MAGIC_SIZE);
+    binary_put_u32(header+8, SPECTRUM_VERSION);
+    binary_put_u32(header+12, SPECTRUM_HEADER_SIZE);
+    binary_put_u32(header+16, (uint32_t)s->definition.type);
+    binary_put_u32(header+20, s->n_axes);
+    binary_put_u32(header+24, (uint32_t)s->definition.adc_x);
+    binary_put_u32(header+28, (uint32_t)(s->definition.type == SPECTRUM_MATRIX?s->definition.adc_y:s->definition.adc_x));
+    binary_put_u64(header+32, s->outside);
+    spectrum_put_axis(header+40, &s->axes[0]);
+    if(s->n_axes == 2)
+        spectrum_put_axis(header+72, &s->axes[1]);
+    ok=fwrite(header, 1, sizeof(header), f) == sizeof(header);
+    for(axis=0; axis < s->n_axes; axis++) {
+        ok=ok && spectrum_write_values(f, s->axes[axis].n_bins, spectrum_edge, &s->axes[axis]);
+    }
+    ok=ok && spectrum_write_values(f, spectrum_size(s), spectrum_count, s->counts);
+    ok=(fclose(f) == 0) && ok;
+    if(!ok)
+        fprintf(stderr, "Error writing spectrum to \"%s\".\n", s->definition.filename);
+    return ok;
+}
+
+int spectra_write(const spectra_t *s) {
+    unsigned int i;
+    int ok=1;
+    for(i=0; i < s->n_spectra; i++) {
+        ok=spectrum_write(&s->spectra[i]) && ok;
+    }
+    return ok;
+}
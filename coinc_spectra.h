@@ -0,0 +1,75 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_SPECTRA_H
+#define COINC_SPECTRA_H
+
+#include "coinc_event.h"
+#include "coinc_engine.h"
+#include "coinc_histogram.h"
+
+#define SPECTRA_MAX 64
+#define SPECTRUM_CHANNELS_DEFAULT 8192
+#define SPECTRUM_MATRIX_BINS_DEFAULT 1024 /* Per axis */
+
+/* Spectra and matrices accumulated from the coincidences as they are found, so that routine monitoring does not need
+ * the coincidences to be written out and histogrammed again. Each is written to its own file when done, all integers
+ * little-endian:
+ *
+ *   offset  size  field
+ *        0     8  magic "COINCHST"
+ *        8     4  format version (SPECTRUM_VERSION)
+ *       12     4  header size in bytes, the bin edges start at this offset
+ *       16     4  type (SPECTRUM_*)
+ *       20     4  number of axes, 1 or 2
+ *       24     4  ADC of the first axis
+ *       28     4  ADC of the second axis
+ *       32     8  number of values outside the axes
+ *       40    32  first axis: low (signed, 8), high (signed, 8), bin width (8, 0 for logarithmic bins), k of
+ *                 logarithmic bins (4, 0 for linear bins, see coinc_histogram.h), bins (4)
+ *       72    32  second axis, zero for spectra
+ *      104    24  reserved, must be zero
+ *
+ * followed by the lowest value in each bin of the first axis (signed, 8 bytes each), the same for the second axis, and
+ * the counts (8 bytes each), the first axis running fastest. */
+
+#define SPECTRUM_MAGIC "COINCHST"
+#define SPECTRUM_MAGIC_SIZE 8
+#define SPECTRUM_VERSION 1
+#define SPECTRUM_HEADER_SIZE 128
+
+typedef enum SPECTRUM_TYPE_E {
+    SPECTRUM_CHANNELS = 0, /* Channels of adc_x in the coincidences */
+    SPECTRUM_MATRIX = 1, /* Channels of adc_x against channels of adc_y, when both are in a coincidence */
+    SPECTRUM_TIMEDIFF_MATRIX = 2 /* Channels of adc_x against its time differences to the trigger */
+} spectrum_type;
+
+struct spectrum_definition {
+    spectrum_type type;
+    int adc_x, adc_y;
+    const char *filename;
+};
+
+typedef struct spectrum_definition spectrum_definition_t;
+
+typedef struct spectra spectra_t;
+
+/* Channel axes run from 0 to channels-1, time difference axes over the window of the ADC with the binning of the time
+ * difference histograms of config. Spectra have at most HISTOGRAM_BINS_DEFAULT bins, matrices matrix_bins bins per axis.
+ * Returns NULL if memory could not be allocated. */
+spectra_t *spectra_create(const spectrum_definition_t *definitions, unsigned int n_spectra, long long int channels, unsigned int matrix_bins, const engine_config_t *config);
+spectra_t *spectra_create_empty(const spectra_t *s); /* Same definitions and axes, no counts. Returns NULL on failure. */
+void spectra_free(spectra_t *s);
+void spectra_fill(spectra_t *s, const coincidence_t *c);
+void spectra_add(spectra_t *s, const spectra_t *other); /* other must have been created with spectra_create_empty(s) */
+int spectra_write(const spectra_t *s); /* Writes every spectrum to its file. Returns 0 after printing an error. */
+
+#endif /* COINC_SPECTRA_H */
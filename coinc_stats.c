@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <coinc_config.h>
+#include "coinc_stats.h"
+
+#define STATS_TMP_SUFFIX ".tmp"
+
+static const char *stage_names[STATS_STAGES]={"parse", "search", "output"};
+
+static const double percentiles[]={0.01, 0.05, 0.95, 0.99};
+#define N_PERCENTILES (sizeof(percentiles)/sizeof(percentiles[0]))
+
+static double wall_time(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static double cpu_time(void) {
+    return (double)clock()/CLOCKS_PER_SEC;
+}
+
+void stats_timer_init(stats_timer_t *timer) {
+    memset(timer, 0, sizeof(stats_timer_t));
+    timer->wall_start=timer->wall_mark=wall_time();
+    timer->cpu_start=timer->cpu_mark=cpu_time();
+    timer->stage=-1;
+}
+
+void stats_timer_switch(stats_timer_t *timer, int stage) {
+    double wall=wall_time(), cpu=cpu_time();
+    if(timer->stage >= 0) {
+        timer->wall[timer->stage]+=wall-timer->wall_mark;
+        timer->cpu[timer->stage]+=cpu-timer->cpu_mark;
+    }
+    timer->wall_mark=wall;
+    timer->cpu_mark=cpu;
+    timer->stage=stage;
+    if(stage >= 0)
+        timer->timed=1;
+}
+
+static double ratio(double a, double b) {
+    return b > 0.0?a/b:0.0;
+}
+
+static void write_adc(FILE *f, const engine_stats_t *stats, unsigned int adc) {
+    unsigned int i;
+    fprintf(f, "    {\"adc\": %u, \"events\": %llu, \"in_coincidences\": %llu, \"fraction_in_coincidences\": %.6f, \"fraction_of_coincidences\": %.6f, \"timediff_percentiles\": {",
+            adc, stats->n_adc_events[adc], stats->n_coinc_adc_events[adc],
+            ratio(stats->n_coinc_adc_events[adc], stats->n_adc_events[adc]),
+            ratio(stats->n_coinc_adc_events[adc], stats->n_coincidences));
+    for(i=0; i < N_PERCENTILES; i++) {
+        fprintf(f, "%s\"%g\": %lli", i?", ":"", percentiles[i]*100.0, coinc_histogram_percentile(&stats->timediff_histogram[adc], percentiles[i]));
+    }
+    fprintf(f, "}}");
+}
+
+static void write_stats(FILE *f, const engine_stats_t *stats, const engine_config_t *config, const stats_timer_t *timer, int complete) {
+    double wall=wall_time()-timer->wall_start, cpu=cpu_time()-timer->cpu_start, accidentals=0.0;
+    unsigned long long int n_triggers=(config->trigger_adc == ENGINE_TRIGGERLESS)?0:stats->n_adc_events[config->trigger_adc];
+    unsigned int adc, i, n_written=0;
+    fprintf(f, "{\n");
+    fprintf(f, "  \"version\": \"%s\",\n", coinc_VERSION);
+    fprintf(f, "  \"complete\": %s,\n", complete?"true":"false");
+    fprintf(f, "  \"events\": %llu,\n", stats->n_events);
+    fprintf(f, "  \"coincidences\": %llu,\n", stats->n_coincidences);
+    fprintf(f, "  \"triggers\": %llu,\n", n_triggers);
+    fprintf(f, "  \"truncated_triggers\": %llu,\n", stats->n_truncated);
+    fprintf(f, "  \"truncated_fraction\": %.6g,\n", ratio(stats->n_truncated, n_triggers));
+    fprintf(f, "  \"out_of_order_events\": %llu,\n", stats->n_out_of_order);
+    fprintf(f, "  \"wall_seconds\": %.6f,\n", wall);
+    fprintf(f, "  \"cpu_seconds\": %.6f,\n", cpu);
+    fprintf(f, "  \"events_per_second\": %.1f,\n", ratio(stats->n_events, wall));
+    if(timer->timed) {
+        fprintf(f, "  \"stages\": {\n");
+        for(i=0; i < STATS_STAGES; i++) {
+            fprintf(f, "    \"%s\": {\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"events_per_second\": %.1f}%s\n",
+                    stage_names[i], timer->wall[i], timer->cpu[i], ratio(stats->n_events, timer->wall[i]), (i+1 < STATS_STAGES)?",":"");
+        }
+        fprintf(f, "  },\n");
+    } else {
+        fprintf(f, "  \"stages\": null,\n");
+    }
+    fprintf(f, "  \"adcs\": [\n");
+    for(adc=0; adc < config->n_adcs; adc++) {
+        if(!stats->n_adc_events[adc])
+            continue;
+        if(n_written++)
+            fprintf(f, ",\n");
+        write_adc(f, stats, adc);
+    }
+    fprintf(f, "%s  ]", n_written?"\n":"");
+    if(config->n_delays) {
+        fprintf(f, ",\n  \"delayed_windows\": [\n");
+        for(i=0; i < config->n_delays; i++) {
+            fprintf(f, "    {\"delay\": %lli, \"coincidences\": %llu}%s\n", config->delay[i], stats->n_delayed_coincidences[i], (i+1 < config->n_delays)?",":"");
+            accidentals+=stats->n_delayed_coincidences[i];
+        }
+        fprintf(f, "  ],\n  \"accidentals\": %.1f", accidentals/config->n_delays);
+    }
+    fprintf(f, "\n}\n");
+}
+
+int stats_write(const char *filename, const engine_stats_t *stats, const engine_config_t *config, const stats_timer_t *timer, int complete) {
+    size_t len=strlen(filename);
+    char *tmp_filename=malloc(len+sizeof(STATS_TMP_SUFFIX));
+    FILE *f;
+    int ok;
+    if(!tmp_filename)
+        return 0;
+    memcpy(tmp_filename, filename, len);
+    memcpy(tmp_filename+len, STATS_TMP_SUFFIX, sizeof(STATS_TMP_SUFFIX));
+    f=fopen(tmp_filename, "w");
+    if(!f) {
+        free(tmp_filename);
+        return 0;
+    }
+    write_stats(f, stats, config, timer, complete);
+    ok=!ferror(f);
+    ok=(fclose(f) == 0) && ok;
+    if(ok) {
+        ok=(rename(tmp_filename, filename) == 0);
+    } else {
+        remove(tmp_filename);
+    }
+    free(tmp_filename);
+    return ok;
+}
@@ -0,0 +1,45 @@
+/*
+    Copyright (C) 2013-2020 Jaakko Julin <jaakko.julin@jyu.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    See file COPYING for details.
+*/
+
+#ifndef COINC_STATS_H
+#define COINC_STATS_H
+
+#include "coinc_engine.h"
+
+#define STATS_BATCH_EVENTS 4096 /* Events read and searched at a time when the stages are timed */
+
+typedef enum STATS_STAGE_E {
+    STATS_STAGE_PARSE = 0, /* Reading and parsing the input */
+    STATS_STAGE_SEARCH = 1, /* Coincidence search */
+    STATS_STAGE_OUTPUT = 2, /* Monitors, spectra and writing the coincidences */
+    STATS_STAGES = 3
+} stats_stage;
+
+/* Wall and CPU time of the whole run and of the stages. The clocks are read only when switching stages, so a stage
+ * should last for a batch of events rather than a single one. */
+struct stats_timer {
+    double wall_start, cpu_start;
+    double wall_mark, cpu_mark; /* When the current stage began */
+    int stage; /* Current stage, -1 if none */
+    int timed; /* The stages were timed */
+    double wall[STATS_STAGES], cpu[STATS_STAGES];
+};
+
+typedef struct stats_timer stats_timer_t;
+
+void stats_timer_init(stats_timer_t *timer); /* Starts the run, no stage */
+void stats_timer_switch(stats_timer_t *timer, int stage); /* Ends the current stage and begins stage (-1 for none) */
+
+/* Writes the statistics as JSON (see README.md). The file is written under a temporary name and renamed, so that it
+ * can be read at any time while it is rewritten with snapshots. complete is 0 for snapshots. Returns 0 on failure. */
+int stats_write(const char *filename, const engine_stats_t *stats, const engine_config_t *config, const stats_timer_t *timer, int complete);
+
+#endif /* COINC_STATS_H */
@@ -0,0 +1,24 @@
+# Runs one of the coinc programs, which exit with status 1 on success, and compares its output with a reference.
+#   -DPROGRAM=path -DARGS="arguments" [-DOUTPUT="files" -DREFERENCE="files"] [-DUNAVAILABLE=regex]
+# Several outputs (e.g. spectra) are given separated by spaces, each is compared with the reference in the same place.
+# If the error output matches UNAVAILABLE (e.g. a kernel not supported by this computer), the test passes without
+# comparing anything.
+
+separate_arguments(ARGS UNIX_COMMAND "${ARGS}")
+execute_process(COMMAND ${PROGRAM} ${ARGS} RESULT_VARIABLE result ERROR_VARIABLE errors)
+if(UNAVAILABLE AND errors MATCHES "${UNAVAILABLE}")
+    message(STATUS "Not available on this computer, skipped: ${errors}")
+    return()
+endif()
+if(NOT result EQUAL 1)
+    message(FATAL_ERROR "${PROGRAM} failed (exit status ${result}):\n${errors}")
+endif()
+separate_arguments(OUTPUT UNIX_COMMAND "${OUTPUT}")
+separate_arguments(REFERENCE UNIX_COMMAND "${REFERENCE}")
+foreach(output IN LISTS OUTPUT)
+    list(POP_FRONT REFERENCE reference)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${output} ${reference} RESULT_VARIABLE differ)
+    if(differ)
+        message(FATAL_ERROR "${output} differs from ${reference}")
+    endif()
+endforeach()
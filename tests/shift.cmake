@@ -0,0 +1,23 @@
+# Adds OFFSET to the timestamps of a text input and keeps their lowest BITS bits, as a board started later or with a
+# narrower counter would have written them, for merging them back with --timestamp-offset and --timestamp-bits.
+#   -DINPUT=file -DOUTPUT=file -DOFFSET=ticks [-DBITS=bits]
+
+file(STRINGS ${INPUT} lines)
+list(POP_FRONT lines header)
+set(mask -1)
+if(BITS)
+    math(EXPR mask "(1<<${BITS})-1")
+endif()
+file(WRITE ${OUTPUT} "${header}\n")
+set(shifted "")
+foreach(line IN LISTS lines)
+    string(REGEX MATCH "^([0-9]+ [0-9]+) ([0-9]+)$" line "${line}")
+    math(EXPR timestamp "(${CMAKE_MATCH_2}+${OFFSET})&${mask}")
+    string(APPEND shifted "${CMAKE_MATCH_1} ${timestamp}\n")
+    string(LENGTH "${shifted}" length)
+    if(length GREATER 20000) # Appending to a long string is slow
+        file(APPEND ${OUTPUT} "${shifted}")
+        set(shifted "")
+    endif()
+endforeach()
+file(APPEND ${OUTPUT} "${shifted}")
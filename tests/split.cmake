@@ -0,0 +1,14 @@
+# Splits a text input into two inputs by ADC, for merging them back with --input.
+#   -DINPUT=file -DLOW=file -DHIGH=file -DFIRST_HIGH=adc
+# The events of ADCs below FIRST_HIGH (at most 10) go to LOW and the rest to HIGH, both after the header line.
+
+file(READ ${INPUT} content)
+string(FIND "${content}" "\n" header_end)
+string(SUBSTRING "${content}" 0 ${header_end} header)
+math(EXPR last_low "${FIRST_HIGH}-1")
+string(REGEX MATCHALL "\n[0-${last_low}] [^\n]*" low "${content}")
+string(REGEX MATCHALL "\n([${FIRST_HIGH}-9]|[0-9][0-9]+) [^\n]*" high "${content}")
+string(REPLACE ";" "" low "${low}")
+string(REPLACE ";" "" high "${high}")
+file(WRITE ${LOW} "${header}${low}\n")
+file(WRITE ${HIGH} "${header}${high}\n")